@@ -15,7 +15,8 @@ ABCLineSet::ABCLineSet(Material& in_material, int in_nbase, double* in_base, int
   LineSet(in_material,true, false/* true */),
   nLines(std::max(in_nbase, in_ndir)),
   base(in_nbase, in_base), 
-  direction(in_ndir, in_dir)
+  direction(in_ndir, in_dir),
+  segmentsValid(false)
 {
   /* We'll set up 1 segment per line.  Each segment has 2 vertices, and each vertex
    gets 3 color components and 1 alpha component. */
@@ -51,14 +52,18 @@ AABox& ABCLineSet::getBoundingBox(Subscene* subscene)
 
 void ABCLineSet::renderBegin(RenderContext* renderContext)
 {
-  updateSegments(renderContext->subscene);
-  invalidateDisplaylist();
+  if (updateSegments(renderContext->subscene))
+    invalidateDisplaylist();
   LineSet::renderBegin(renderContext);
 }
 
-void ABCLineSet::updateSegments(SceneNode* subscene)
+bool ABCLineSet::updateSegments(SceneNode* subscene)
 {
   AABox sceneBBox = ((Subscene*)subscene)->getBoundingBox();
+  if (segmentsValid && sceneBBox == segmentBBox)
+    return false;
+  segmentBBox = sceneBBox;
+  segmentsValid = true;
   double bbox[2][3] = { {sceneBBox.vmin.x, sceneBBox.vmin.y, sceneBBox.vmin.z},
   {sceneBBox.vmax.x, sceneBBox.vmax.y, sceneBBox.vmax.z} };
   double x[2][3];
@@ -93,6 +98,7 @@ void ABCLineSet::updateSegments(SceneNode* subscene)
       setVertex(2*elem + 1, missing);
     }
   }
+  return true;
 }
 
 void ABCLineSet::getAttribute(SceneNode* subscene, AttribID attrib, int first, int count, double* result)
@@ -14,6 +14,8 @@ private:		/* Use parametrization (x,y,z) + s*(a,b,c) */
   int		nLines;
   ARRAY<Vertex> base; /* (x,y,z) */  
   ARRAY<Vertex> direction; /* (a,b,c) */
+  AABox		segmentBBox;	/* the bounding box the segments were clipped to */
+  bool		segmentsValid;
 public:
   ABCLineSet(Material& in_material, int in_nbase, double* in_base, int in_ndir, double* in_dir);
   
@@ -33,9 +35,14 @@ public:
   virtual void renderBegin(RenderContext* renderContext);
 
   /**
-   * update mesh
+   * the segments follow the bounding box
    */
-  void updateSegments(SceneNode* subscene);
+  virtual bool getCentersChange() { return true; }
+
+  /**
+   * update mesh if the bounding box has changed; returns whether it did
+   */
+  bool updateSegments(SceneNode* subscene);
   
   /**
    * update then get attributes 
@@ -123,7 +123,7 @@ using namespace rgl;
 //
 
 AxisInfo::AxisInfo()
-: textArray()
+: textArray(), tickLow(0), tickHigh(0), tickMode(-1)
 {
   mode  = AXIS_LENGTH;
   nticks = 0;
@@ -133,6 +133,7 @@ AxisInfo::AxisInfo()
 }
 
 AxisInfo::AxisInfo(int in_nticks, double* in_ticks, char** in_texts, int in_len, float in_unit)
+: tickLow(0), tickHigh(0), tickMode(-1)
 {
  
   int i;
@@ -168,7 +169,7 @@ AxisInfo::AxisInfo(int in_nticks, double* in_ticks, char** in_texts, int in_len,
 }
 
 AxisInfo::AxisInfo(AxisInfo& from) 
-: textArray(from.textArray)
+: textArray(from.textArray), tickLow(0), tickHigh(0), tickMode(-1)
 {
   mode = from.mode;
   nticks = from.nticks;
@@ -188,48 +189,71 @@ AxisInfo::~AxisInfo()
   }
 }
 
-void AxisInfo::draw(RenderContext* renderContext, Vertex4& v, Vertex4& dir, Matrix4x4& modelview, 
-                    Vertex& marklen, std::string& string) {
-#ifndef RGL_NO_OPENGL
-  Vertex4 p;
-  GLboolean valid;
-    
-  // draw mark ( 1 time ml away )
-
-  p.x = v.x + dir.x * marklen.x;
-  p.y = v.y + dir.y * marklen.y;
-  p.z = v.z + dir.z * marklen.z;  
-  
-  glBegin(GL_LINES);
-  glVertex3f(v.x,v.y,v.z);
-  glVertex3f(p.x,p.y,p.z);
-  glEnd();
-  
-  // draw text ( 2 times ml away )
-
-  p.x = v.x + 2 * dir.x * marklen.x;
-  p.y = v.y + 2 * dir.y * marklen.y;
-  p.z = v.z + 2 * dir.z * marklen.z; 
+static std::string formatTick(float value)
+{
+  char text[32];
+  snprintf(text, 32, "%.4g", value);
+  return text;
+}
 
-  glRasterPos3f( p.x, p.y, p.z );
-  
-  glGetBooleanv(GL_CURRENT_RASTER_POSITION_VALID, &valid);
-  if (valid) {  
-    // Work out the text adjustment 
-  
-    float adj = 0.5;  
-    Vertex4 eyedir = modelview * dir;
-    bool  xlarge = fabs(eyedir.x) > fabs(eyedir.y);
-  
-    if (xlarge) {
-      adj = fabs(eyedir.y)/fabs(eyedir.x)/2.0f;
-      if (eyedir.x < 0) adj = 1.0f - adj;
+void AxisInfo::layoutTicks(float low, float high)
+{
+  if (tickMode == mode && tickLow == low && tickHigh == high)
+    return;
+  tickMode = mode;
+  tickLow = low;
+  tickHigh = high;
+  tickValues.clear();
+  tickTexts.clear();
+  switch (mode) {
+    case AXIS_CUSTOM: {
+      for (int j = 0; j < nticks && j < (int)textArray.size(); j++) {
+        float value = ticks[j];
+        // clip marks
+        if ((value >= low) && (value <= high)) {
+          tickValues.push_back(value);
+          tickTexts.push_back(textArray[j]);
+        }
+      }
+      break;
     }
-    if (renderContext->font)
-      renderContext->font->draw(string.c_str(), string.size(), adj, 0.5, 0.5, 0, 
-                                *renderContext);
-  }      
-#endif
+    case AXIS_LENGTH: {
+      float delta = (len>1) ? (high-low)/(len-1) : 0;
+      for (int k = 0; k < len; k++) {
+        float value = low + delta * (float)k;
+        tickValues.push_back(value);
+        tickTexts.push_back(formatTick(value));
+      }
+      break;
+    }
+    case AXIS_UNIT: {
+      float value =  ( (float) ( (int) ( ( low+(unit-1) ) / (unit) ) ) ) * (unit);
+      while (value < high) {
+        tickValues.push_back(value);
+        tickTexts.push_back(formatTick(value));
+        value += unit;
+      }
+      break;
+    }
+    case AXIS_PRETTY: {
+      /* These are the defaults from the R pretty() function, except min_n is 3 */
+      double lo=low, up=high, shrink_sml=0.75, high_u_fact[2];
+      int ndiv=len, min_n=3, eps_correction=0;
+      
+      high_u_fact[0] = 1.5;
+      high_u_fact[1] = 2.75;
+      unit = static_cast<float>(R_pretty0(&lo, &up, &ndiv, min_n, shrink_sml, high_u_fact, 
+                                          eps_correction, 0));
+      for (int i=(int)lo; i<=up; i++) {
+        float value = i*unit;
+        if (value >= low && value <= high) {
+          tickValues.push_back(value);
+          tickTexts.push_back(formatTick(value));
+        }
+      }
+      break;
+    }
+  }
 }
 
 int AxisInfo::getNticks(float low, float high) {
@@ -374,7 +398,12 @@ BBoxDeco::BBoxDeco(Material& in_material, AxisInfo& in_xaxis, AxisInfo& in_yaxis
 #ifndef RGL_NO_OPENGL  
   , axisBusy(false)
 #endif
+  , backFaces(-1), layoutValid(false), layoutFaces(-1)
 {
+  for (int i = 0; i < 3; i++)
+    layoutEdges[i] = -1;
+  faceBuffer.setEnabled(true);
+  markBuffer.setEnabled(true);
   material.colors.recycle(2);
 }
 
@@ -399,44 +428,44 @@ AABox BBoxDeco::getBoundingBox(const AABox& in_bbox) const
 
 struct BBoxDeco::BBoxDecoImpl {
   
-  static Edge* chooseEdge(RenderContext* renderContext, BBoxDeco& bboxdeco, int coord) 
+  static Edge* axisEdges(int coord, int* nedges)
   {
-    
-    AABox bbox = renderContext->subscene->getBoundingBox();
-    
-    Vertex center = bbox.getCenter();
-    bbox += center + (bbox.vmin - center)*bboxdeco.expand;
-    bbox += center + (bbox.vmax - center)*bboxdeco.expand;
-    
-    // edge adjacent matrix
-    
-    int adjacent[8][8] = { { 0 } };
-    
-    int i,j;
-    
-    // vertex array:
-    
-    Vertex4 boxv[8] = {
-      Vertex4( bbox.vmin.x, bbox.vmin.y, bbox.vmin.z ),
-      Vertex4( bbox.vmax.x, bbox.vmin.y, bbox.vmin.z ),
-      Vertex4( bbox.vmin.x, bbox.vmax.y, bbox.vmin.z ),
-      Vertex4( bbox.vmax.x, bbox.vmax.y, bbox.vmin.z ),
-      Vertex4( bbox.vmin.x, bbox.vmin.y, bbox.vmax.z ),
-      Vertex4( bbox.vmax.x, bbox.vmin.y, bbox.vmax.z ),
-      Vertex4( bbox.vmin.x, bbox.vmax.y, bbox.vmax.z ),
-      Vertex4( bbox.vmax.x, bbox.vmax.y, bbox.vmax.z )
-    };
-    
-    Vertex4 eyev[8];
-    
-    // transform vertices: used for edge distance criterion and text justification
-    
-    Matrix4x4 modelview(renderContext->subscene->modelMatrix);
-    
-    for(i=0;i<8;i++)
-      eyev[i] = modelview * boxv[i];
-    
-    for(i=0;i<6;i++) {
+    switch(coord)
+    {
+      case 0:
+        *nedges = 4;
+        return xaxisedge;
+      case 1:
+        *nedges = 8;
+        return yaxisedge;
+      case 2:
+      default:
+        *nedges = 4;
+        return zaxisedge;
+    }
+  }
+  
+  static int edgeIndex(Edge* edge, int coord)
+  {
+    int nedges;
+    return edge ? static_cast<int>(edge - axisEdges(coord, &nedges)) : -1;
+  }
+  
+  // corners are numbered with bit 0 for x, 1 for y and 2 for z at the maximum
+  
+  static Vertex4 corner(const AABox& bbox, int k)
+  {
+    return Vertex4( (k & 1) ? bbox.vmax.x : bbox.vmin.x,
+                    (k & 2) ? bbox.vmax.y : bbox.vmin.y,
+                    (k & 4) ? bbox.vmax.z : bbox.vmin.z );
+  }
+  
+  // bit i is set if side i faces away from the viewer
+  
+  static int getBackFaces(const Matrix4x4& modelview)
+  {
+    int faces = 0;
+    for (int i=0;i<6;i++) {
       
       const Vertex4 q = modelview * side[i].normal;
       const Vertex4 view(0.0f,0.0f,1.0f,0.0f);
@@ -449,97 +478,168 @@ struct BBoxDeco::BBoxDecoImpl {
         cos_a = view2 * q;
       }
       
-      const bool front = (cos_a >= 0.0f) ? true : false;
-      
-      if (bboxdeco.draw_front || !front) {
-        
+      if (cos_a < 0.0f)
+        faces |= 1 << i;
+    }
+    return faces;
+  }
+  
+  // the contours are the edges of exactly one back face, in that face's direction
+  
+  static void findContours(BBoxDeco& bboxdeco, int faces)
+  {
+    int adjacent[8][8] = { { 0 } };
+    int i,j;
+    
+    for(i=0;i<6;i++)
+      if (faces & (1 << i))
         for(j=0;j<4;j++) {
-          
-          if (!front) {
-            // modify adjacent matrix
-            
-            int from = side[i].vidx[j];
-            int to   = side[i].vidx[(j+1)%4];
-            
-            adjacent[from][to] = 1;
-          }          
-          
+          int from = side[i].vidx[j];
+          int to   = side[i].vidx[(j+1)%4];
+          adjacent[from][to] = 1;
         }
-        
+    
+    for(i=0;i<3;i++) {
+      int nedges;
+      Edge* axisedge = axisEdges(i, &nedges);
+      bboxdeco.contours[i].clear();
+      for(j=0;j<nedges;j++) {
+        int from = axisedge[j].from;
+        int to   = axisedge[j].to;
+        if ((adjacent[from][to] == 1) && (adjacent[to][from] == 0))
+          bboxdeco.contours[i].push_back(j);
       }
     }
+    bboxdeco.backFaces = faces;
+  }
+  
+  static Edge* chooseEdge(RenderContext* renderContext, BBoxDeco& bboxdeco, int coord) 
+  {
+    Matrix4x4 modelview(renderContext->subscene->modelMatrix);
     
-    Edge*  axisedge;
-    int    nedges;
+    int faces = getBackFaces(modelview);
+    if (faces != bboxdeco.backFaces)
+      findContours(bboxdeco, faces);
     
-    switch(coord)
-    {
-      case 0:
-        axisedge = xaxisedge;
-        nedges   = 4;
-        break;
-      case 1:
-        axisedge = yaxisedge;
-        nedges   = 8;
-        break;
-      case 2:
-      default:
-        axisedge = zaxisedge;
-        nedges   = 4;
-        break;
-    }
+    const std::vector<int>& contours = bboxdeco.contours[coord];
+    int nedges;
+    Edge* axisedge = axisEdges(coord, &nedges);
+    if (contours.empty())
+      return NULL;
+    if (contours.size() == 1)
+      return &axisedge[contours[0]];
+    
+    AABox bbox = renderContext->subscene->getBoundingBox();
+    
+    Vertex center = bbox.getCenter();
+    bbox += center + (bbox.vmin - center)*bboxdeco.expand;
+    bbox += center + (bbox.vmax - center)*bboxdeco.expand;
     
     // search z-nearest contours
     
     float d = FLT_MAX;
     Edge* edge = NULL;
     
-    for(j=0;j<nedges;j++) {
-      
-      int from = axisedge[j].from;
-      int to   = axisedge[j].to;
+    for(size_t j=0;j<contours.size();j++) {
       
-      if ((adjacent[from][to] == 1) && (adjacent[to][from] == 0)) {
+      Edge* contour = &axisedge[contours[j]];
+      float dtmp = -((modelview * corner(bbox, contour->from)).z 
+                   + (modelview * corner(bbox, contour->to)).z)/2.0f;
         
-        // found contour
-        
-        float dtmp = -(eyev[from].z + eyev[to].z)/2.0f;
-        
-        if (dtmp < d) {
+      if (dtmp < d) {
           
-          // found near contour
+        // found near contour
           
-          d = dtmp;
-          edge = &axisedge[j];
+        d = dtmp;
+        edge = contour;
           
+      }
+    }
+    return edge;
+  }
+  
+  // the face quads, tick marks and label positions for one box and choice of edges
+  
+  static void layout(BBoxDeco& bboxdeco, AABox bbox, int faces, Edge* edges[3])
+  {
+    int i,j;
+    
+    bboxdeco.faceVertices.clear();
+    for(i=0;i<6;i++)
+      if (bboxdeco.draw_front || (faces & (1 << i)))
+        for(j=0;j<4;j++) {
+          Vertex4 v = corner(bbox, side[i].vidx[j]);
+          bboxdeco.faceVertices.push_back(side[i].normal.x);
+          bboxdeco.faceVertices.push_back(side[i].normal.y);
+          bboxdeco.faceVertices.push_back(side[i].normal.z);
+          bboxdeco.faceVertices.push_back(v.x);
+          bboxdeco.faceVertices.push_back(v.y);
+          bboxdeco.faceVertices.push_back(v.z);
         }
-        
-      } 
+    
+    Vertex marklen = bboxdeco.getMarkLength(bbox);
+    AxisInfo* axes[3] = { &bboxdeco.xaxis, &bboxdeco.yaxis, &bboxdeco.zaxis };
+    
+    bboxdeco.markVertices.clear();
+    bboxdeco.labels.clear();
+    for(i=0;i<3;i++) {
+      AxisInfo* axis = axes[i];
+      if (!edges[i] || axis->mode == AXIS_USER || axis->mode == AXIS_NONE)
+        continue;
+      axis->layoutTicks(bbox.vmin[i], bbox.vmax[i]);
       
+      Vertex4 v = corner(bbox, edges[i]->from);
+      const Vertex4& dir = edges[i]->dir;
+      for(j=0;j<(int)axis->tickValues.size();j++) {
+        v[i] = axis->tickValues[j];
+        
+        // mark ( 1 time ml away ), text ( 2 times ml away )
+        
+        Label label;
+        label.pos = Vertex(v.x + 2 * dir.x * marklen.x,
+                           v.y + 2 * dir.y * marklen.y,
+                           v.z + 2 * dir.z * marklen.z);
+        label.axis = i;
+        label.tick = j;
+        bboxdeco.labels.push_back(label);
+        
+        float mark[6] = { v.x, v.y, v.z,
+                          v.x + dir.x * marklen.x,
+                          v.y + dir.y * marklen.y,
+                          v.z + dir.z * marklen.z };
+        bboxdeco.markVertices.insert(bboxdeco.markVertices.end(), mark, mark + 6);
+      }
     }
-    return edge;
+    
+    bboxdeco.faceBuffer.invalidate();
+    bboxdeco.markBuffer.invalidate();
+    bboxdeco.layoutBox = bbox;
+    bboxdeco.layoutFaces = faces;
+    for(i=0;i<3;i++)
+      bboxdeco.layoutEdges[i] = edgeIndex(edges[i], i);
+    bboxdeco.layoutValid = true;
+  }
+  
+  // the text adjustment for labels along dir
+  
+  static float labelAdj(const Matrix4x4& modelview, const Vertex4& dir)
+  {
+    float adj = 0.5;  
+    Vertex4 eyedir = modelview * dir;
+    bool  xlarge = fabs(eyedir.x) > fabs(eyedir.y);
+  
+    if (xlarge) {
+      adj = fabs(eyedir.y)/fabs(eyedir.x)/2.0f;
+      if (eyedir.x < 0) adj = 1.0f - adj;
+    }
+    return adj;
   }
   
   static Edge* fixedEdge(Material* material)
   {
-    Edge* axisedge = xaxisedge;
-    int i,j, lim = 4, coord = material->marginCoord;
+    int i,j, lim, coord = material->marginCoord;
     bool match;
-    switch(coord) {
-      case 0: 
-        // Initialized to this case to suppress "may be unused" message
-        // axisedge = xaxisedge;
-        // lim = 4;
-        break;
-      case 1: 
-        axisedge = yaxisedge; 
-        lim = 8;
-        break;
-      case 2: 
-        axisedge = zaxisedge;
-        lim = 4;
-        break;
-    }
+    Edge* axisedge = axisEdges(coord, &lim);
     for (j = 0; j < lim; j++) {
       match = true;
       for (i = 0; i < 3; i++)
@@ -601,6 +701,9 @@ struct BBoxDeco::BBoxDecoImpl {
   };
 };
 
+/* The layout only changes with the bounding box or the choice of edges,
+   so most frames just redraw the buffers and position the labels. */
+
 void BBoxDeco::render(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL  
@@ -610,26 +713,31 @@ void BBoxDeco::render(RenderContext* renderContext)
     
     glPushAttrib(GL_ENABLE_BIT);
     
-    int i,j;
-    
-    // vertex array:
-    
-    Vertex4 boxv[8] = {
-      Vertex4( bbox.vmin.x, bbox.vmin.y, bbox.vmin.z ),
-      Vertex4( bbox.vmax.x, bbox.vmin.y, bbox.vmin.z ),
-      Vertex4( bbox.vmin.x, bbox.vmax.y, bbox.vmin.z ),
-      Vertex4( bbox.vmax.x, bbox.vmax.y, bbox.vmin.z ),
-      Vertex4( bbox.vmin.x, bbox.vmin.y, bbox.vmax.z ),
-      Vertex4( bbox.vmax.x, bbox.vmin.y, bbox.vmax.z ),
-      Vertex4( bbox.vmin.x, bbox.vmax.y, bbox.vmax.z ),
-      Vertex4( bbox.vmax.x, bbox.vmax.y, bbox.vmax.z )
-    };
+    int i;
     
     // 
     // // transform vertices: used for edge distance criterion and text justification
     // 
     Matrix4x4 modelview(renderContext->subscene->modelMatrix);
     
+    int faces = BBoxDecoImpl::getBackFaces(modelview);
+    if (faces != backFaces)
+      BBoxDecoImpl::findContours(*this, faces);
+    
+    // find contours
+    
+    AxisInfo* axes[3] = { &xaxis, &yaxis, &zaxis };
+    Edge* edges[3];
+    bool changed = !layoutValid || bbox != layoutBox || faces != layoutFaces;
+    for(i=0;i<3;i++) {
+      edges[i] = (axes[i]->mode == AXIS_NONE) ? NULL 
+               : BBoxDecoImpl::chooseEdge(renderContext, *this, i);
+      if (BBoxDecoImpl::edgeIndex(edges[i], i) != layoutEdges[i])
+        changed = true;
+    }
+    if (changed)
+      BBoxDecoImpl::layout(*this, bbox, faces, edges);
+    
     // setup material
     
     material.beginUse(renderContext);
@@ -640,200 +748,81 @@ void BBoxDeco::render(RenderContext* renderContext)
       
     }
     
-    // draw back faces
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
     
-    glBegin(GL_QUADS);
+    // draw back faces
     
-    for(i=0;i<6;i++) {
-      
-      const Vertex4 q = modelview * side[i].normal;
-      const Vertex4 view(0.0f,0.0f,1.0f,0.0f);
-      
-      float cos_a = view * q;
-      
-      if (cos_a == 0.0f) {
-        Vertex4 view2(1.0f,0.0f,0.0f,0.0f);
-        cos_a = view2 * q;
-      }
-      
-      const bool front = (cos_a >= 0.0f) ? true : false;
-      
-      if (draw_front || !front) {
-        
-        // draw face
-        
-        glNormal3f(side[i].normal.x, side[i].normal.y, side[i].normal.z);
-        
-        for(j=0;j<4;j++) {
-          
-          // feed vertex
-          
-          Vertex4& v = boxv[ side[i].vidx[j] ];
-          glVertex3f(v.x, v.y, v.z);
-          
-        }
-        
-      }
+    if (faceVertices.size()) {
+      const float* base = &faceVertices[0];
+      bool buffered = faceBuffer.bind(base, faceVertices.size()*sizeof(float));
+      if (buffered)
+        base = 0;
+      glEnableClientState(GL_NORMAL_ARRAY);
+      glNormalPointer(GL_FLOAT, 6*sizeof(float), base);
+      glVertexPointer(3, GL_FLOAT, 6*sizeof(float), base + 3);
+      if (buffered)
+        faceBuffer.unbind();
+      glDrawArrays(GL_QUADS, 0, faceVertices.size()/6);
+      glDisableClientState(GL_NORMAL_ARRAY);
     }
     
-    glEnd();
+    // draw axis and tickmarks
     
-    // setup mark length
+    glDisable(GL_LIGHTING);
     
-    Vertex marklen = getMarkLength(bbox);
+    material.useColor(1);
     
+    if (markVertices.size()) {
+      const float* base = &markVertices[0];
+      bool buffered = markBuffer.bind(base, markVertices.size()*sizeof(float));
+      glVertexPointer(3, GL_FLOAT, 0, buffered ? 0 : base);
+      if (buffered)
+        markBuffer.unbind();
+      glDrawArrays(GL_LINES, 0, markVertices.size()/3);
+    }
+    glPopClientAttrib();
+    SAVEGLERROR;
     
-    // draw axis and tickmarks
-    // find contours
+    // draw text, justified by the direction of the marks on screen
     
-    glDisable(GL_LIGHTING);
+    float adj[3] = { 0.5f, 0.5f, 0.5f };
+    for(i=0;i<3;i++)
+      if (edges[i])
+        adj[i] = BBoxDecoImpl::labelAdj(modelview, edges[i]->dir);
     
-    material.useColor(1);
+    if (renderContext->font) {
+      std::vector<Label>::const_iterator iter;
+      for (iter = labels.begin(); iter != labels.end(); ++iter) {
+        GLboolean valid;
+        glRasterPos3f( iter->pos.x, iter->pos.y, iter->pos.z );
+        glGetBooleanv(GL_CURRENT_RASTER_POSITION_VALID, &valid);
+        if (valid) {
+          const std::string& text = axes[iter->axis]->tickTexts[iter->tick];
+          renderContext->font->draw(text.c_str(), text.size(), adj[iter->axis], 0.5, 0.5, 0, 
+                                    *renderContext);
+        }
+      }
+    }
     
     for(i=0;i<3;i++) {
-      Vertex4 v;
-      AxisInfo*  axis;
-      float* valueptr;
-      float  low, high;
-      switch(i)
-      {
-        case 0:
-          axis     = &xaxis;       
-          valueptr = &v.x;
-          low      = bbox.vmin.x;
-          high     = bbox.vmax.x;
-          break;
-        case 1:
-          axis     = &yaxis;
-          valueptr = &v.y;
-          low      = bbox.vmin.y;
-          high     = bbox.vmax.y;
-          break;
-        case 2:
-        default:
-          axis     = &zaxis;
-          valueptr = &v.z;
-          low      = bbox.vmin.z;
-          high     = bbox.vmax.z;
-          break;
-      }
-      if (axis->mode == AXIS_NONE)
-        continue;
-      
-      Edge* edge = BBoxDecoImpl::chooseEdge(renderContext, *this, i); 
-      
-      if (axis->mode == AXIS_USER) {
-        
-        if (!axisBusy) {
-          axisBusy = true;
-          if (axisCallback[i]) {
-            int e[3];
-            if (edge) {
-              e[0] = edge->code[0];
-              e[1] = edge->code[1];
-              e[2] = edge->code[2];
-            } else{
-              e[0] = 0;
-              e[1] = 0;
-              e[2] = 0;
-            }
-            axisCallback[i](axisData[i], i, e);
-            axisBusy = false;
+      if (axes[i]->mode == AXIS_USER && !axisBusy) {
+        axisBusy = true;
+        if (axisCallback[i]) {
+          int e[3];
+          if (edges[i]) {
+            e[0] = edges[i]->code[0];
+            e[1] = edges[i]->code[1];
+            e[2] = edges[i]->code[2];
+          } else{
+            e[0] = 0;
+            e[1] = 0;
+            e[2] = 0;
           }
+          axisCallback[i](axisData[i], i, e);
+          axisBusy = false;
         }
-      } else if (edge) {
-        
-        v = boxv[edge->from];
-        
-        switch (axis->mode) {
-        case AXIS_CUSTOM:
-        {
-          // draw axis and tickmarks
-          
-          std::vector<std::string>::iterator  iter;
-          
-          
-          for (iter = axis->textArray.begin(), j=0; (j<axis->nticks) && (iter != axis->textArray.end());++iter, j++) {
-            
-            float value = axis->ticks[j];
-            
-            // clip marks
-            
-            if ((value >= low) && (value <= high)) {
-              
-              *valueptr = value;
-              axis->draw(renderContext, v, edge->dir, modelview, marklen, *iter);
-            }
-            
-          }
-        }
-        break;
-        case AXIS_LENGTH:
-        {
-          float delta = (axis->len>1) ? (high-low)/((axis->len)-1) : 0;
-  
-          for(int k=0;k<axis->len;k++)
-          {
-            float value = low + delta * (float)k;
-  
-            *valueptr = value;
-  
-            char text[32];
-            snprintf(text, 32, "%.4g", value);
-              
-            std::string string = text;
-              
-            axis->draw(renderContext, v, edge->dir, modelview, marklen, string);
-          }
-        }
-        break;
-        case AXIS_UNIT:
-        {
-          float value =  ( (float) ( (int) ( ( low+(axis->unit-1) ) / (axis->unit) ) ) ) * (axis->unit);
-          while(value < high) {
-                
-            *valueptr = value;
-                
-            char text[32];
-            snprintf(text, 32, "%.4g", value);
-                
-            std::string s = text;
-                
-            axis->draw(renderContext, v, edge->dir, modelview, marklen, s );
-                
-            value += axis->unit;
-          }
-        }
-        break;
-        case AXIS_PRETTY:
-        {
-        /* These are the defaults from the R pretty() function, except min_n is 3 */
-          double lo=low, up=high, shrink_sml=0.75, high_u_fact[2];
-          int ndiv=axis->len, min_n=3, eps_correction=0;
-                
-          high_u_fact[0] = 1.5;
-          high_u_fact[1] = 2.75;
-          axis->unit = static_cast<float>(R_pretty0(&lo, &up, &ndiv, min_n, shrink_sml, high_u_fact, 
-                                                    eps_correction, 0));
-                
-          for (int i=(int)lo; i<=up; i++) {
-            float value = i*axis->unit;
-            if (value >= low && value <= high) {
-              *valueptr = value;
-                    
-              char text[32];
-              snprintf(text, 32, "%.4g", value);
-                    
-              std::string s = text;
-                    
-              axis->draw(renderContext, v, edge->dir, modelview, marklen, s );
-            }
-          }
-        }
-        break;
-        }
-        
-       }
+      }
     }
     material.endUse(renderContext);
     glPopAttrib();
@@ -841,48 +830,77 @@ void BBoxDeco::render(RenderContext* renderContext)
 #endif  
 }
 
-Vec3 BBoxDeco::marginVecToDataVec(Vec3 marginvec, RenderContext* renderContext, Material* material) {
-  /* Create permutation to map at, line, pos to x, y, z */
-  int at = 0, line = 0, level = 0; /* initialize to suppress warning */
-  Vec3 trans, scale;
-  BBoxDecoImpl::setMarginParameters(renderContext, *this, material,
-        &at, &line, &level,
-        &trans, &scale); 
-  if (at == NA_INTEGER) return Vertex(NA_REAL, NA_REAL, NA_REAL);
+MarginTransform::MarginTransform()
+: at(-1), line(0), level(0), atmin(0.0f), atmax(0.0f)
+{
+}
+
+static inline bool sameVec(const Vec3& a, const Vec3& b)
+{
+  return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+bool MarginTransform::operator == (const MarginTransform& that) const
+{
+  return at == that.at && line == that.line && level == that.level
+      && sameVec(trans, that.trans) && sameVec(scale, that.scale)
+      && atmin == that.atmin && atmax == that.atmax;
+}
+
+Vec3 MarginTransform::apply(const Vec3& marginvec) const
+{
+  if (at == NA_INTEGER || at < 0) return Vertex(NA_REAL, NA_REAL, NA_REAL);
   /* It might make more sense to do this by
    * modifying the MODELVIEW matrix, but 
    * I couldn't get that right for some reason...
    */
-  Vertex result;
-  AABox bbox = renderContext->subscene->getBoundingBox();
+  Vertex result, s(scale), t(trans);
   if (marginvec.missing())
-    result[at] = (bbox.vmin[at] + bbox.vmax[at])/2.0;
+    result[at] = (atmin + atmax)/2.0;
   else if (marginvec.x == -INFINITY)
-    result[at] = bbox.vmin[at];
+    result[at] = atmin;
   else if (marginvec.x == INFINITY)
-    result[at] = bbox.vmax[at];
+    result[at] = atmax;
   else
-    result[at] = marginvec.x*scale[at] + trans[at];
-  result[line] = marginvec.y*scale[line] + trans[line];
-  result[level] = marginvec.z*scale[level] + trans[level];
+    result[at] = marginvec.x*s[at] + t[at];
+  result[line] = marginvec.y*s[line] + t[line];
+  result[level] = marginvec.z*s[level] + t[level];
   return result;
 }
 
-Vec3 BBoxDeco::marginNormalToDataNormal(Vec3 marginvec, RenderContext* renderContext, Material* material) {
-  int at=0, line=0, level=0; /* initialize to suppress warning */
-  Vec3 trans, scale;
-  BBoxDecoImpl::setMarginParameters(renderContext, *this, material,
-                                    &at, &line, &level,
-                                    &trans, &scale); 
-  if (at == NA_INTEGER)
+Vec3 MarginTransform::applyNormal(const Vec3& marginvec) const
+{
+  if (at == NA_INTEGER || at < 0)
     return Vertex(NA_REAL, NA_REAL, NA_REAL);
-  Vertex result;
-  result[at] = marginvec.x/scale[at];
-  result[line] = marginvec.y/scale[line];
-  result[level] = marginvec.z/scale[level];
+  Vertex result, s(scale);
+  result[at] = marginvec.x/s[at];
+  result[line] = marginvec.y/s[line];
+  result[level] = marginvec.z/s[level];
+  return result;
+}
+
+MarginTransform BBoxDeco::getMarginTransform(RenderContext* renderContext, Material* material) {
+  /* Create permutation to map at, line, pos to x, y, z */
+  MarginTransform result;
+  BBoxDecoImpl::setMarginParameters(renderContext, *this, material,
+        &result.at, &result.line, &result.level,
+        &result.trans, &result.scale); 
+  if (result.at != NA_INTEGER) {
+    AABox bbox = renderContext->subscene->getBoundingBox();
+    result.atmin = bbox.vmin[result.at];
+    result.atmax = bbox.vmax[result.at];
+  }
   return result;
 }
 
+Vec3 BBoxDeco::marginVecToDataVec(Vec3 marginvec, RenderContext* renderContext, Material* material) {
+  return getMarginTransform(renderContext, material).apply(marginvec);
+}
+
+Vec3 BBoxDeco::marginNormalToDataNormal(Vec3 marginvec, RenderContext* renderContext, Material* material) {
+  return getMarginTransform(renderContext, material).applyNormal(marginvec);
+}
+
 void BBoxDeco::setAxisCallback(userAxisPtr fn, void* user, int axis)
 {
   axisCallback[axis] = fn;
@@ -895,6 +913,7 @@ void BBoxDeco::setAxisCallback(userAxisPtr fn, void* user, int axis)
     case 2: zaxis.mode = AXIS_USER;
             break;
   }
+  layoutValid = false;
 }
 
 void BBoxDeco::getAxisCallback(userAxisPtr *fn, void** user, int axis)
@@ -15,6 +15,7 @@
 
 #include "RenderContext.h"
 #include "Material.h"
+#include "BufferObject.h"
 
 namespace rgl {
 
@@ -32,8 +33,11 @@ struct AxisInfo {
   AxisInfo(int in_nticks, double* in_values, char** in_texts, int xlen, float xunit);
   AxisInfo(AxisInfo& from);
   ~AxisInfo();
-  void draw(RenderContext* renderContext, Vertex4& v, Vertex4& dir, Matrix4x4& modelview, 
-            Vertex& marklen, std::string& string);
+  /**
+   * set tickValues and tickTexts to the marks drawn between low and high;
+   * they are only recomputed when the range or the mode changes
+   **/
+  void layoutTicks(float low, float high);
             
   int getNticks(float low, float high);
   double getTick(float low, float high, int index); /* double since it might be NA_REAL */
@@ -44,6 +48,34 @@ struct AxisInfo {
   int    len;
   float  unit;
   std::vector<std::string> textArray;
+  
+  std::vector<float> tickValues;
+  std::vector<std::string> tickTexts;
+private:
+  float  tickLow, tickHigh;
+  int    tickMode;	/* -1 until the first layout */
+};
+
+//
+// STRUCT
+//   MarginTransform
+//
+// The map from margin coordinates to data coordinates for one material
+// in one subscene.  It depends only on the bounding box, the chosen edge
+// and the mark length, so shapes keep their transformed vertices until
+// it changes.
+//
+
+struct MarginTransform {
+  MarginTransform();
+  Vec3 apply(const Vec3& marginvec) const;
+  Vec3 applyNormal(const Vec3& marginvec) const;
+  bool operator == (const MarginTransform& that) const;
+  bool operator != (const MarginTransform& that) const { return !(*this == that); }
+
+  int   at, line, level;  /* at is NA_INTEGER if there is no edge, -1 if unset */
+  Vec3  trans, scale;
+  float atmin, atmax;     /* the bounding box along at */
 };
 
 typedef void (*userAxisPtr)(void *userData, int axis, int edge[3]);
@@ -62,6 +94,7 @@ public:
   Material* getMaterial()  { return &material; }
   virtual std::string getTypeName() { return "bboxdeco"; };
   Vec3 marginVecToDataVec(Vec3 marginvec, RenderContext* renderContext, Material* material);
+  MarginTransform getMarginTransform(RenderContext* renderContext, Material* material);
   Vec3 marginNormalToDataNormal(Vec3 marginvec, RenderContext* renderContext, Material* material);
   void setAxisCallback(userAxisPtr fn, void * user, int axis);
   void getAxisCallback(userAxisPtr *fn, void ** user, int axis);
@@ -79,6 +112,27 @@ private:
 #endif
   userAxisPtr axisCallback[3];
   void* axisData[3];
+  
+  /* The contour edges an axis may use depend only on which sides of
+     the box face away from the viewer, so they are only searched again
+     when the view crosses into another octant. */
+  int backFaces;		/* bit i set if side i faces away; -1 if unset */
+  std::vector<int> contours[3];	/* indices into each axis' edge table */
+  
+  /* The faces, tick marks and label positions for one bounding box and
+     choice of edges, kept until either changes. */
+  struct Label {
+    Vertex pos;
+    int axis, tick;
+  };
+  bool layoutValid;
+  AABox layoutBox;
+  int layoutFaces;
+  int layoutEdges[3];		/* -1 if the axis has no edge */
+  std::vector<float> faceVertices;	/* normal and position of each corner */
+  std::vector<float> markVertices;
+  std::vector<Label> labels;
+  BufferObject faceBuffer, markBuffer;
 
   static Material defaultMaterial;
   static AxisInfo defaultAxis;
@@ -0,0 +1,116 @@
+#include "BufferObject.h"
+
+#include "R.h"
+
+using namespace rgl;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CLASS
+//   BufferObject
+//
+
+BufferObject::BufferObject(bool in_indices)
+: enabled(false), indices(in_indices),
+#ifndef RGL_NO_OPENGL
+  id(0),
+#endif
+  allocated(0), dirtyBegin(0), dirtyEnd(0)
+{
+}
+
+BufferObject::BufferObject(const BufferObject& src)
+: enabled(src.enabled), indices(src.indices),
+#ifndef RGL_NO_OPENGL
+  id(0),
+#endif
+  allocated(0), dirtyBegin(0), dirtyEnd(0)
+{
+}
+
+BufferObject& BufferObject::operator=(const BufferObject& src)
+{
+  if (this != &src) {
+    release();
+    enabled = src.enabled;
+    indices = src.indices;
+  }
+  return *this;
+}
+
+BufferObject::~BufferObject()
+{
+  release();
+}
+
+bool BufferObject::isSupported()
+{
+#ifndef RGL_NO_OPENGL
+  return GLAD_GL_VERSION_1_5 != 0;
+#else
+  return false;
+#endif
+}
+
+bool BufferObject::bind(const void* data, size_t size)
+{
+#ifndef RGL_NO_OPENGL
+  if (!enabled || !size || !data || !isSupported())
+    return false;
+  GLenum target = indices ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER;
+  if (!id)
+    glGenBuffers(1, &id);
+  glBindBuffer(target, id);
+  if (allocated != size) {
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    allocated = size;
+  } else if (dirtyBegin < dirtyEnd) {
+    if (dirtyEnd > size)
+      dirtyEnd = size;
+    glBufferSubData(target, dirtyBegin, dirtyEnd - dirtyBegin,
+                    (const char*)data + dirtyBegin);
+  }
+  dirtyBegin = dirtyEnd = 0;
+  SAVEGLERROR;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void BufferObject::unbind()
+{
+#ifndef RGL_NO_OPENGL
+  if (id)
+    glBindBuffer(indices ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER, 0);
+#endif
+}
+
+void BufferObject::invalidate()
+{
+  allocated = 0;
+}
+
+void BufferObject::invalidate(size_t offset, size_t size)
+{
+  if (dirtyBegin < dirtyEnd) {
+    if (offset < dirtyBegin)
+      dirtyBegin = offset;
+    if (offset + size > dirtyEnd)
+      dirtyEnd = offset + size;
+  } else {
+    dirtyBegin = offset;
+    dirtyEnd = offset + size;
+  }
+}
+
+void BufferObject::release()
+{
+#ifndef RGL_NO_OPENGL
+  if (id)
+    glDeleteBuffers(1, &id);
+  id = 0;
+#endif
+  allocated = 0;
+  dirtyBegin = dirtyEnd = 0;
+}
@@ -0,0 +1,70 @@
+#ifndef RGL_BUFFER_OBJECT_H
+#define RGL_BUFFER_OBJECT_H
+
+#include <cstddef>
+
+#include "opengl.h"
+
+namespace rgl {
+
+//
+// CLASS
+//   BufferObject
+//
+// Holds a copy of a client side array in GPU memory.  The client array stays
+// authoritative:  changes are recorded with invalidate() and only the dirty
+// range is uploaded on the next bind().  If buffer objects are not available
+// (OpenGL < 1.5, or the NULL device) bind() returns false and the caller
+// falls back to passing client memory.
+//
+
+class BufferObject
+{
+public:
+  BufferObject(bool in_indices = false);
+  /**
+   * copies the settings, not the GL buffer
+   **/
+  BufferObject(const BufferObject& src);
+  BufferObject& operator=(const BufferObject& src);
+  ~BufferObject();
+
+  static bool isSupported();
+
+  /**
+   * only enabled buffers are used; disabled ones cost nothing
+   **/
+  void setEnabled(bool in_enabled) { enabled = in_enabled; }
+  bool isEnabled() const { return enabled; }
+
+  /**
+   * bind the buffer, uploading dirty parts of data first.
+   * Returns false if the client array should be used instead.
+   **/
+  bool bind(const void* data, size_t size);
+  void unbind();
+
+  /**
+   * mark all or part of the client array as changed
+   **/
+  void invalidate();
+  void invalidate(size_t offset, size_t size);
+
+  /**
+   * free the GL buffer
+   **/
+  void release();
+
+private:
+  bool     enabled;
+  bool     indices;
+#ifndef RGL_NO_OPENGL
+  GLuint   id;
+#endif
+  size_t   allocated;
+  size_t   dirtyBegin, dirtyEnd;
+};
+
+} // namespace rgl
+
+#endif // RGL_BUFFER_OBJECT_H
@@ -79,6 +79,21 @@ void ClipPlaneSet::enable(bool show)
 #endif
 }
 
+bool ClipPlaneSet::clipsBBox(const AABox& bbox)
+{
+  for (int i=0; i<nPlanes; i++) {
+    Vertex n = normal.getRecycled(i);
+    /* the corner furthest along the normal */
+    float a = n.x*(n.x > 0 ? bbox.vmax.x : bbox.vmin.x)
+            + n.y*(n.y > 0 ? bbox.vmax.y : bbox.vmin.y)
+            + n.z*(n.z > 0 ? bbox.vmax.z : bbox.vmin.z)
+            + offset.getRecycled(i);
+    if (a < 0)
+      return true;
+  }
+  return false;
+}
+
 void ClipPlaneSet::intersectBBox(AABox& bbox)
 {
   GLfloat a, b, c, d, a1, b1, c1, d1;
@@ -43,6 +43,11 @@ public:
   bool isClipPlane(void) { return true; }
   
   void intersectBBox(AABox& bbox);
+  
+  /**
+   * is all of bbox clipped away by one of the planes?
+   **/
+  bool clipsBBox(const AABox& bbox);
 
 };
 
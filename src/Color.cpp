@@ -158,7 +158,9 @@ ColorArray::ColorArray( Color& bg, Color &fg )
   hint_alphablend = ( (bg.getAlphaub() < 255) || (fg.getAlphaub() < 255) ) ? true : false;
 }
 
-ColorArray::ColorArray( ColorArray& src ) {
+ColorArray::ColorArray( ColorArray& src ) 
+: buffer(src.buffer)
+{
   ncolor = src.ncolor;
   nalpha = src.nalpha;
   hint_alphablend = src.hint_alphablend;
@@ -180,6 +182,7 @@ void ColorArray::set( int in_ncolor, char** in_color, int in_nalpha, double* in_
   ncolor  = getMax(in_ncolor, in_nalpha);
   nalpha  = in_nalpha;
   u8* ptr = arrayptr = (u8*) realloc( arrayptr, sizeof(u8) * 4 * ncolor);
+  buffer.invalidate();
 
   hint_alphablend = false;
 
@@ -201,6 +204,7 @@ void ColorArray::set( int in_ncolor, int* in_color, int in_nalpha, double* in_al
   ncolor  = getMax(in_ncolor, in_nalpha);
   nalpha  = in_nalpha;
   u8* ptr = arrayptr = (u8*) realloc( arrayptr, sizeof(u8) * 4 * ncolor);
+  buffer.invalidate();
 
   hint_alphablend = false;
 
@@ -233,7 +237,11 @@ bool ColorArray::hasAlpha() const
 void ColorArray::useArray() const
 {
 #ifndef RGL_NO_OPENGL
-  glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*) arrayptr );
+  if (buffer.bind(arrayptr, ncolor*4*sizeof(u8))) {
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*) 0 );
+    buffer.unbind();
+  } else
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*) arrayptr );
 #endif
 }
 
@@ -268,6 +276,7 @@ void ColorArray::recycle(unsigned int newsize)
         arrayptr = NULL;
 
       ncolor = newsize;
+      buffer.invalidate();
     }
   }
 }
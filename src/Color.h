@@ -11,6 +11,7 @@
 //
 
 #include "types.h"
+#include "BufferObject.h"
 
 namespace rgl {
 
@@ -59,13 +60,16 @@ public:
   void useArray() const;
   unsigned int getLength() const;
   Color getColor( int index ) const;
+  const u8* getColorPtr( int index ) const { return arrayptr + index*4; }
   void recycle( unsigned int newsize );
   bool hasAlpha() const;
+  void useBufferObject( bool in_use ) { buffer.setEnabled(in_use); }
 private:
   bool hint_alphablend;
   unsigned int ncolor;
   unsigned int nalpha;
   u8* arrayptr;
+  mutable BufferObject buffer;
   friend class Material;
 };
 
@@ -35,10 +35,11 @@ public: // -- all methods are blocking until action completed
   bool snapshot(int format, const char* filename);
   bool pixels(int* ll, int* size, int component, double* result);
   bool postscript(int format, const char* filename, bool drawText);
+  void flush(void); // -- draw now if a change is waiting to be drawn
 
   bool clear(TypeID stackTypeID);
   int add(SceneNode* node); // -- return a unique id if successful, or zero if not
-  bool pop(TypeID stackTypeID, int id);
+  int pop(TypeID stackTypeID, const int* ids, int n); // -- returns the number of ids handled
   bool hasWindow() { return window != NULL; }
   // accessor method for Scene, modeled after getBoundingBox()
   // from scene.h
@@ -0,0 +1,281 @@
+#include "GlyphAtlas.h"
+
+#ifdef HAVE_FREETYPE
+
+#include "FTLibrary.h"
+#include "R.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace rgl;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CLASS
+//   GlyphAtlas
+//
+
+// texture width, and height before it first grows
+#define ATLAS_WIDTH  512
+#define ATLAS_HEIGHT 128
+
+// empty texels around each glyph, so filtering never reaches a neighbour
+#define ATLAS_PAD 1
+
+// pixels to the em in the texture
+#define SDF_SIZE 32
+
+// distance, in texels, from the outline to the ends of the value range;
+// the field is this much larger than the glyph on every side
+#define SDF_SPREAD 4
+
+// glyphs are rendered this many times larger, and the field sampled down
+#define SDF_OVERSAMPLE 4
+
+#define EDT_INF 1e20f
+
+GlyphAtlas::GlyphAtlas(const char* fontname)
+: face(NULL), width(ATLAS_WIDTH), height(ATLAS_HEIGHT), maxHeight(0),
+  shelfX(0), shelfY(0), shelfHeight(0), changed(true)
+#ifndef RGL_NO_OPENGL
+  , texture(0), textureHeight(0)
+#endif
+{
+  const FT_Library* library = FTLibrary::Instance().GetLibrary();
+  if (!library || FT_New_Face(*library, fontname, 0, &face)) {
+    face = NULL;
+    return;
+  }
+  if (FT_Set_Char_Size(face, 0L, SDF_SIZE*SDF_OVERSAMPLE*64, 72, 72)) {
+    FT_Done_Face(face);
+    face = NULL;
+    return;
+  }
+  pixels.assign(width*height, 0);
+}
+
+GlyphAtlas::~GlyphAtlas()
+{
+#ifndef RGL_NO_OPENGL
+  if (texture)
+    glDeleteTextures(1, &texture);
+#endif
+  if (face)
+    FT_Done_Face(face);
+}
+
+int GlyphAtlas::getSize()
+{
+  return SDF_SIZE;
+}
+
+/* Find room for a w by h block on the current shelf, starting a new
+   shelf or growing the texture as needed. */
+
+bool GlyphAtlas::place(int w, int h, int* x, int* y)
+{
+  if (!maxHeight) {
+    /* glyphs are only placed while drawing, so a context is current */
+    maxHeight = ATLAS_HEIGHT;
+#ifndef RGL_NO_OPENGL
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    while (2*maxHeight <= maxSize)
+      maxHeight *= 2;
+#endif
+  }
+  if (w > width)
+    return false;
+  if (shelfX + w > width) {
+    shelfY += shelfHeight;
+    shelfX = 0;
+    shelfHeight = 0;
+  }
+  while (shelfY + h > height) {
+    if (2*height > maxHeight)
+      return false;
+    height *= 2;
+    pixels.resize(width*height, 0);
+  }
+  *x = shelfX;
+  *y = shelfY;
+  shelfX += w;
+  if (h > shelfHeight)
+    shelfHeight = h;
+  return true;
+}
+
+/* Squared distance transform of one row (Felzenszwalb and Huttenlocher,
+   "Distance Transforms of Sampled Functions"):  d[q] is the minimum of
+   (q - p)^2 + f[p] over p. */
+
+static void edt1d(const float* f, int n, float* d, int* v, float* z)
+{
+  int k = 0;
+  v[0] = 0;
+  z[0] = -EDT_INF;
+  z[1] = EDT_INF;
+  for (int q = 1; q < n; q++) {
+    float s;
+    for (;;) {
+      int p = v[k];
+      s = ((f[q] + q*q) - (f[p] + p*p))/(2*q - 2*p);
+      if (s > z[k] || !k)
+        break;
+      k--;
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = EDT_INF;
+  }
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k+1] < q)
+      k++;
+    d[q] = (q - v[k])*(q - v[k]) + f[v[k]];
+  }
+}
+
+/* grid holds 0 at the feature pixels and EDT_INF elsewhere; on return
+   it holds the squared distance to the nearest feature pixel */
+
+static void distanceTransform(std::vector<float>& grid, int w, int h)
+{
+  int n = std::max(w, h);
+  std::vector<float> f(n), d(n), z(n + 1);
+  std::vector<int> v(n);
+  for (int x = 0; x < w; x++) {
+    for (int y = 0; y < h; y++)
+      f[y] = grid[y*w + x];
+    edt1d(&f[0], h, &d[0], &v[0], &z[0]);
+    for (int y = 0; y < h; y++)
+      grid[y*w + x] = d[y];
+  }
+  for (int y = 0; y < h; y++) {
+    edt1d(&grid[y*w], w, &d[0], &v[0], &z[0]);
+    std::copy(d.begin(), d.begin() + w, grid.begin() + y*w);
+  }
+}
+
+/* The glyph is rendered SDF_OVERSAMPLE times larger than the field,
+   thresholded, and the distances to the outline found on that grid;
+   each texel takes the mean of the four samples at its centre. */
+
+const GlyphAtlas::Glyph* GlyphAtlas::getGlyph(unsigned int code)
+{
+  std::map<unsigned int, Glyph>::iterator found = glyphs.find(code);
+  if (found != glyphs.end())
+    return &found->second;
+  if (!face)
+    return NULL;
+
+  /* unhinted, so the outline scales to every size */
+  FT_UInt index = FT_Get_Char_Index(face, code);
+  if (FT_Load_Glyph(face, index, FT_LOAD_NO_HINTING)
+   || FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL)
+   || face->glyph->format != FT_GLYPH_FORMAT_BITMAP)
+    return NULL;
+
+  FT_GlyphSlot slot = face->glyph;
+  const FT_Bitmap& bitmap = slot->bitmap;
+  const int pad = SDF_SPREAD*SDF_OVERSAMPLE;
+  Glyph glyph;
+  glyph.left = (float)(slot->bitmap_left - pad)/SDF_OVERSAMPLE;
+  glyph.top = (float)(slot->bitmap_top + pad)/SDF_OVERSAMPLE;
+  glyph.width = glyph.height = 0;
+  glyph.advance = slot->linearHoriAdvance/65536.0f/SDF_OVERSAMPLE;
+  glyph.x = glyph.y = 0;
+  if (bitmap.width && bitmap.rows) {
+    int gw = bitmap.width + 2*pad, gh = bitmap.rows + 2*pad;
+    std::vector<float> outside(gw*gh, EDT_INF), inside(gw*gh, 0.0f);
+    for (int row = 0; row < (int)bitmap.rows; row++) {
+      const unsigned char* src = bitmap.buffer + row*bitmap.pitch;
+      for (int col = 0; col < (int)bitmap.width; col++) {
+        bool in = bitmap.pixel_mode == FT_PIXEL_MODE_MONO 
+                ? (src[col >> 3] & (0x80 >> (col & 7))) != 0 
+                : src[col] >= 128;
+        if (in) {
+          outside[(row + pad)*gw + col + pad] = 0.0f;
+          inside[(row + pad)*gw + col + pad] = EDT_INF;
+        }
+      }
+    }
+    distanceTransform(outside, gw, gh);
+    distanceTransform(inside, gw, gh);
+    
+    glyph.width = (gw + SDF_OVERSAMPLE - 1)/SDF_OVERSAMPLE;
+    glyph.height = (gh + SDF_OVERSAMPLE - 1)/SDF_OVERSAMPLE;
+    if (!place(glyph.width + ATLAS_PAD, glyph.height + ATLAS_PAD, &glyph.x, &glyph.y))
+      return NULL;
+    for (int y = 0; y < glyph.height; y++)
+      for (int x = 0; x < glyph.width; x++) {
+        float sum = 0.0f;
+        for (int k = 0; k < 4; k++) {
+          int sx = x*SDF_OVERSAMPLE + SDF_OVERSAMPLE/2 - 1 + (k & 1),
+              sy = y*SDF_OVERSAMPLE + SDF_OVERSAMPLE/2 - 1 + (k >> 1);
+          if (sx >= gw || sy >= gh)
+            sum -= pad;
+          else {
+            int i = sy*gw + sx;
+            /* positive inside, measured to the pixel edges */
+            sum += outside[i] > 0.0f ? 0.5f - sqrtf(outside[i]) 
+                                     : sqrtf(inside[i]) - 0.5f;
+          }
+        }
+        float value = 0.5f + sum/(8.0f*pad);
+        pixels[(glyph.y + y)*width + glyph.x + x] = 
+          (u8)(255.0f*std::min(std::max(value, 0.0f), 1.0f) + 0.5f);
+      }
+    changed = true;
+  }
+  return &(glyphs[code] = glyph);
+}
+
+float GlyphAtlas::getKerning(unsigned int left, unsigned int right)
+{
+  FT_Vector kern;
+  if (!face || !FT_HAS_KERNING(face)
+   || FT_Get_Kerning(face, FT_Get_Char_Index(face, left),
+                     FT_Get_Char_Index(face, right), FT_KERNING_UNFITTED, &kern))
+    return 0.0f;
+  return kern.x/64.0f/SDF_OVERSAMPLE;
+}
+
+bool GlyphAtlas::bind()
+{
+#ifndef RGL_NO_OPENGL
+  if (!face)
+    return false;
+  if (!texture) {
+    glGenTextures(1, &texture);
+    textureHeight = 0;
+  }
+  glBindTexture(GL_TEXTURE_2D, texture);
+  if (changed) {
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (textureHeight != height) {
+      /* the distances interpolate, so the outline stays smooth when magnified */
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, width, height, 0,
+                   GL_ALPHA, GL_UNSIGNED_BYTE, &pixels[0]);
+      textureHeight = height;
+    } else
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                      GL_ALPHA, GL_UNSIGNED_BYTE, &pixels[0]);
+    glPopClientAttrib();
+    changed = false;
+  }
+  SAVEGLERROR;
+  return true;
+#else
+  return false;
+#endif
+}
+
+#endif // HAVE_FREETYPE
@@ -0,0 +1,93 @@
+#ifndef RGL_GLYPH_ATLAS_H
+#define RGL_GLYPH_ATLAS_H
+
+#ifdef HAVE_FREETYPE
+
+#include <map>
+#include <vector>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "opengl.h"
+#include "types.h"
+
+namespace rgl {
+
+//
+// CLASS
+//   GlyphAtlas
+//
+// The glyphs of one FreeType face as signed distance fields in a single
+// alpha texture:  0.5 is the outline, larger values are inside.  Glyphs
+// are rasterized once, on first use, at getSize() pixels to the em, and
+// drawn at any size by scaling the metrics and quads; a linear filter
+// and a threshold in the fragment shader keep the edges sharp.  Fonts
+// that differ only in cex share one atlas (see GLFTFont::shareAtlas).
+// Glyphs are packed in shelves; when the texture is full its height is
+// doubled, so positions are kept in texels.
+//
+
+class GlyphAtlas : public AutoDestroy
+{
+public:
+  GlyphAtlas(const char* fontname);
+  ~GlyphAtlas();
+
+  bool isValid() const { return face != NULL; }
+
+  struct Glyph {
+    float left, top;	/* field corner relative to the pen, y up */
+    int width, height;
+    int x, y;		/* position in the texture */
+    float advance;
+  };
+
+  /**
+   * the glyph of a character code, rasterized on first use; NULL if
+   * it doesn't fit
+   **/
+  const Glyph* getGlyph(unsigned int code);
+
+  /**
+   * horizontal kerning between two character codes
+   **/
+  float getKerning(unsigned int left, unsigned int right);
+
+  /**
+   * bind the texture, uploading new glyphs first
+   **/
+  bool bind();
+
+  /**
+   * pixels to the em of the metrics
+   **/
+  static int getSize();
+
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+
+private:
+  /* not copyable */
+  GlyphAtlas(const GlyphAtlas&);
+  GlyphAtlas& operator=(const GlyphAtlas&);
+
+  bool place(int w, int h, int* x, int* y);
+
+  FT_Face face;
+  std::map<unsigned int, Glyph> glyphs;
+  std::vector<u8> pixels;
+  int width, height, maxHeight;
+  int shelfX, shelfY, shelfHeight;
+  bool changed;
+#ifndef RGL_NO_OPENGL
+  GLuint texture;
+  int textureHeight;	/* height when the texture was allocated */
+#endif
+};
+
+} // namespace rgl
+
+#endif // HAVE_FREETYPE
+
+#endif // RGL_GLYPH_ATLAS_H
@@ -31,7 +31,7 @@ void LineStripSet::drawPrimitive(RenderContext* renderContext, int index)
           vertexArray[elt1].missing()) return;
     }
     if (nindices)
-      glDrawElements(type, 2, GL_UNSIGNED_INT, indices + index);
+      glDrawElements(type, 2, GL_UNSIGNED_INT, indexPointer(index));
     else
       glDrawArrays(type, index, 2);
   }
@@ -2,6 +2,7 @@
 #include "gl2ps.h"
 #include "opengl.h"
 #include "Texture.h"
+#include "OITBuffer.h"
 #include "R.h"
 
 using namespace rgl;
@@ -66,8 +67,6 @@ void Material::setup()
 void Material::beginUse(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL
-  int ncolor = colors.getLength();
-  
   GLenum depthfunc[] = { GL_NEVER, GL_LESS, GL_EQUAL, GL_LEQUAL, GL_GREATER,
                          GL_NOTEQUAL, GL_GEQUAL, GL_ALWAYS };
   
@@ -81,6 +80,12 @@ void Material::beginUse(RenderContext* renderContext)
                          GL_SRC_ALPHA_SATURATE};
   SAVEGLERROR;
   
+  /* the previous shape left the same state in place */
+  if (renderContext->materialApplied) {
+    useColors();
+    return;
+  }
+  
   glDepthFunc(depthfunc[depth_test]);
   glDepthMask(depth_mask ? GL_TRUE : GL_FALSE);
   
@@ -90,9 +95,11 @@ void Material::beginUse(RenderContext* renderContext)
   
   SAVEGLERROR;
 
+  bool oit = renderContext->oit && renderContext->oit->isActive();
+  
   if (!alphablend)
     glDepthMask(GL_TRUE);
-  else {
+  else if (!oit) {
     if (renderContext->gl2psActive == GL2PS_NONE)
       glBlendFunc(blendfunc[blend[0]], blendfunc[blend[1]]);
     else
@@ -163,11 +170,7 @@ void Material::beginUse(RenderContext* renderContext)
 
   SAVEGLERROR;
 
-  if ( (useColorArray) && ( ncolor > 1 ) ) {
-    glEnableClientState(GL_COLOR_ARRAY);
-    colors.useArray();
-  } else
-    colors.useColor(0);
+  useColors();
 
   SAVEGLERROR;
 
@@ -193,6 +196,20 @@ void Material::beginUse(RenderContext* renderContext)
     glDisable(GL_FOG);
   
   SAVEGLERROR;  
+  
+  if (oit)
+    renderContext->oit->useMaterial(this);
+#endif
+}
+
+void Material::useColors()
+{
+#ifndef RGL_NO_OPENGL
+  if ( (useColorArray) && ( colors.getLength() > 1 ) ) {
+    glEnableClientState(GL_COLOR_ARRAY);
+    colors.useArray();
+  } else
+    colors.useColor(0);
 #endif
 }
 
@@ -212,6 +229,10 @@ void Material::endUse(RenderContext* renderContext)
     SAVEGLERROR;
   }
 
+  /* leave the state for the next shape */
+  if (renderContext->materialKeep)
+    return;
+
   if (texture) {
     texture->endUse(renderContext);
     SAVEGLERROR;
@@ -233,6 +254,45 @@ void Material::endUse(RenderContext* renderContext)
 #endif
 }
 
+#define COMPARE(a, b) if ((a) != (b)) return ((a) < (b)) ? -1 : 1
+
+int Material::compareState(const Material& that) const
+{
+  COMPARE(alphablend, that.alphablend);
+  COMPARE(texture.get(), that.texture.get());
+  COMPARE(depth_test, that.depth_test);
+  COMPARE(depth_mask, that.depth_mask);
+  COMPARE(front, that.front);
+  COMPARE(back, that.back);
+  COMPARE(smooth, that.smooth);
+  COMPARE(lit, that.lit);
+  COMPARE(fog, that.fog);
+  COMPARE(point_antialias, that.point_antialias);
+  COMPARE(line_antialias, that.line_antialias);
+  COMPARE(size, that.size);
+  COMPARE(lwd, that.lwd);
+  COMPARE(polygon_offset, that.polygon_offset);
+  if (polygon_offset) {
+    COMPARE(polygon_offset_factor, that.polygon_offset_factor);
+    COMPARE(polygon_offset_units, that.polygon_offset_units);
+  }
+  if (alphablend) {
+    COMPARE(blend[0], that.blend[0]);
+    COMPARE(blend[1], that.blend[1]);
+  }
+  if (lit) {
+    COMPARE(shininess, that.shininess);
+    for (int i = 0; i < 4; i++) {
+      COMPARE(ambient.data[i], that.ambient.data[i]);
+      COMPARE(specular.data[i], that.specular.data[i]);
+      COMPARE(emission.data[i], that.emission.data[i]);
+    }
+  }
+  return 0;
+}
+
+#undef COMPARE
+
 void Material::colorPerVertex(bool enable, int numVertices)
 {
   useColorArray = enable;
@@ -30,7 +30,13 @@ public:
 
   void beginUse(RenderContext* renderContext);
   void endUse(RenderContext* renderContext);
+  /**
+   * order materials by the GL state that beginUse sets, apart from
+   * colors; 0 if the state is the same
+   **/
+  int compareState(const Material& that) const;
   void useColor(int index);
+  void useColors();
   void colorPerVertex(bool enable, int numVertices=0);
   bool isTransparent() const { return alphablend; }
 
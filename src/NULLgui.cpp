@@ -30,6 +30,10 @@ public:
   void hide() {};
   void bringToTop(int stay) {};
   void update() { if (window && !window->skipRedraw) window->paint(); };
+  /* nothing is shown, so the scene is only brought up to date when
+     its values are queried */
+  bool invalidate() { return true; };
+  bool isDisplayed() { return false; };
   void destroy() { if (window) window->notifyDestroy(); };
   void captureMouse(View* pView) {};
   void releaseMouse() {};
@@ -0,0 +1,314 @@
+#include "OITBuffer.h"
+
+#include "Material.h"
+#include "ClipPlane.h"
+#include "R.h"
+
+using namespace rgl;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CLASS
+//   OITBuffer
+//
+
+// The accumulation pass emulates the fixed function fragment stage
+// (texture environment, secondary color and fog) and writes the weighted
+// premultiplied color to the first target and -log(1 - alpha) to the
+// second, so that plain additive blending serves for both.
+
+static const char* accumFragmentSource =
+"#version 120\n"
+"uniform sampler2D texture;\n"
+"uniform int texRGB;    // 0 = none, 1 = modulate, 2 = replace\n"
+"uniform int texAlpha;\n"
+"uniform int fogMode;   // 0 = none, 1 = linear, 2 = exp, 3 = exp2\n"
+"void main() {\n"
+"  vec4 color = gl_Color;\n"
+"  if (texRGB != 0 || texAlpha != 0) {\n"
+"    vec4 t = texture2D(texture, gl_TexCoord[0].st);\n"
+"    if (texRGB == 1) color.rgb *= t.rgb;\n"
+"    else if (texRGB == 2) color.rgb = t.rgb;\n"
+"    if (texAlpha == 1) color.a *= t.a;\n"
+"    else if (texAlpha == 2) color.a = t.a;\n"
+"  }\n"
+"  color.rgb += gl_SecondaryColor.rgb;\n"
+"  if (fogMode != 0) {\n"
+"    float f;\n"
+"    if (fogMode == 1)\n"
+"      f = (gl_Fog.end - gl_FogFragCoord)*gl_Fog.scale;\n"
+"    else if (fogMode == 2)\n"
+"      f = exp(-gl_Fog.density*gl_FogFragCoord);\n"
+"    else\n"
+"      f = exp(-pow(gl_Fog.density*gl_FogFragCoord, 2.0));\n"
+"    color.rgb = mix(gl_Fog.color.rgb, color.rgb, clamp(f, 0.0, 1.0));\n"
+"  }\n"
+"  float a = clamp(color.a, 0.0, 0.999);\n"
+"  float w = clamp(pow(min(1.0, a*10.0) + 0.01, 3.0)*1e8*pow(1.0 - gl_FragCoord.z*0.9, 3.0), 1e-2, 3e3);\n"
+"  gl_FragData[0] = vec4(clamp(color.rgb, 0.0, 1.0)*a, a)*w;\n"
+"  gl_FragData[1] = vec4(-log(1.0 - a));\n"
+"}\n";
+
+static const char* compositeFragmentSource =
+"#version 120\n"
+"uniform sampler2D accum;\n"
+"uniform sampler2D reveal;\n"
+"uniform vec2 size;\n"
+"void main() {\n"
+"  vec2 pos = gl_FragCoord.xy/size;\n"
+"  vec4 sum = texture2D(accum, pos);\n"
+"  if (sum.a <= 1e-5) discard;\n"
+"  float transmit = exp(-texture2D(reveal, pos).r);\n"
+"  gl_FragColor = vec4(sum.rgb/sum.a, 1.0 - transmit);\n"
+"}\n";
+
+OITBuffer::OITBuffer()
+: active(false), failed(false),
+#ifndef RGL_NO_OPENGL
+  framebuffer(0), accumTexture(0), revealTexture(0), depthBuffer(0),
+  savedFramebuffer(0),
+#endif
+  width(0), height(0), viewport(0, 0, 0, 0),
+  accumProgram(NULL, accumFragmentSource),
+  compositeProgram(NULL, compositeFragmentSource)
+{
+}
+
+OITBuffer::~OITBuffer()
+{
+  release();
+}
+
+bool OITBuffer::isSupported()
+{
+#ifndef RGL_NO_OPENGL
+  return GLAD_GL_VERSION_3_0 != 0 && ShaderProgram::isSupported();
+#else
+  return false;
+#endif
+}
+
+bool OITBuffer::canDraw(Material* material)
+{
+  if (material->blend[0] != 6 || material->blend[1] != 7)  /* GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA */
+    return false;
+  if (material->texture && material->texmode != Texture::MODULATE
+                       && material->texmode != Texture::REPLACE)
+    return false;
+  return true;
+}
+
+void OITBuffer::releaseGL()
+{
+  release();
+  accumProgram.release();
+  compositeProgram.release();
+}
+
+void OITBuffer::release()
+{
+#ifndef RGL_NO_OPENGL
+  if (framebuffer)
+    glDeleteFramebuffers(1, &framebuffer);
+  if (accumTexture)
+    glDeleteTextures(1, &accumTexture);
+  if (revealTexture)
+    glDeleteTextures(1, &revealTexture);
+  if (depthBuffer)
+    glDeleteRenderbuffers(1, &depthBuffer);
+  framebuffer = accumTexture = revealTexture = depthBuffer = 0;
+#endif
+  width = height = 0;
+}
+
+#ifndef RGL_NO_OPENGL
+static void initTarget(GLuint texture, GLint format, GLenum components, int width, int height)
+{
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, components, GL_FLOAT, NULL);
+}
+#endif
+
+bool OITBuffer::resize(int in_width, int in_height)
+{
+#ifndef RGL_NO_OPENGL
+  if (framebuffer && width == in_width && height == in_height)
+    return true;
+
+  release();
+  width = in_width;
+  height = in_height;
+
+  glGenFramebuffers(1, &framebuffer);
+  glGenTextures(1, &accumTexture);
+  glGenTextures(1, &revealTexture);
+  glGenRenderbuffers(1, &depthBuffer);
+
+  glPushAttrib(GL_TEXTURE_BIT);
+  initTarget(accumTexture, GL_RGBA32F, GL_RGBA, width, height);
+  initTarget(revealTexture, GL_R16F, GL_RED, width, height);
+  glPopAttrib();
+
+  glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+  /* must match the window's depth format so that it can be blitted */
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  GLint saved;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &saved);
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, revealTexture, 0);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+  bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  glBindFramebuffer(GL_FRAMEBUFFER, saved);
+  SAVEGLERROR;
+
+  if (!complete)
+    release();
+  return complete;
+#else
+  return false;
+#endif
+}
+
+bool OITBuffer::begin(RenderContext* renderContext, const Rect2& in_viewport)
+{
+#ifndef RGL_NO_OPENGL
+  if (failed || !isSupported())
+    return false;
+
+  if (!compositeProgram.use() || !accumProgram.use()
+   || !resize(renderContext->rect.width, renderContext->rect.height)) {
+    ShaderProgram::useNone();
+    failed = true;
+    return false;
+  }
+  viewport = in_viewport;
+
+  /* Copy the depth of the opaque scene.  This fails if the window's depth
+     format doesn't match ours; give up on OIT for this device then. */
+
+  SAVEGLERROR;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &savedFramebuffer);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, savedFramebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  int x1 = viewport.x + viewport.width, y1 = viewport.y + viewport.height;
+  glBlitFramebuffer(viewport.x, viewport.y, x1, y1,
+                    viewport.x, viewport.y, x1, y1,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  if (glGetError() != GL_NO_ERROR) {
+    glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+    ShaderProgram::useNone();
+    failed = true;
+    return false;
+  }
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+
+  GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+  glDrawBuffers(2, buffers);
+
+  glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT | GL_SCISSOR_BIT);
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(viewport.x, viewport.y, viewport.width, viewport.height);
+  glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_ONE, GL_ONE);
+  glEnable(GL_DEPTH_TEST);
+  glDepthMask(GL_FALSE);
+
+  glUniform1i(accumProgram.getUniform("texture"), 0);
+  SAVEGLERROR;
+  active = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void OITBuffer::useMaterial(Material* material)
+{
+#ifndef RGL_NO_OPENGL
+  int texRGB = 0, texAlpha = 0;
+  if (material->texture) {
+    int mode = material->texmode == Texture::REPLACE ? 2 : 1;
+    if (material->textype != Texture::ALPHA)
+      texRGB = mode;
+    if (material->textype == Texture::ALPHA
+     || material->textype == Texture::LUMINANCE_ALPHA
+     || material->textype == Texture::RGBA)
+      texAlpha = mode;
+  }
+  int fogMode = 0;
+  if (glIsEnabled(GL_FOG)) {
+    GLint mode;
+    glGetIntegerv(GL_FOG_MODE, &mode);
+    fogMode = mode == GL_LINEAR ? 1 : mode == GL_EXP ? 2 : 3;
+  }
+  glUniform1i(accumProgram.getUniform("texRGB"), texRGB);
+  glUniform1i(accumProgram.getUniform("texAlpha"), texAlpha);
+  glUniform1i(accumProgram.getUniform("fogMode"), fogMode);
+  /* transparent fragments must not hide each other */
+  glDepthMask(GL_FALSE);
+  SAVEGLERROR;
+#endif
+}
+
+void OITBuffer::end(RenderContext* renderContext)
+{
+#ifndef RGL_NO_OPENGL
+  if (!active)
+    return;
+  active = false;
+
+  glBindFramebuffer(GL_FRAMEBUFFER, savedFramebuffer);
+  glPopAttrib();
+
+  glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT | GL_TEXTURE_BIT);
+  glDisable(GL_DEPTH_TEST);
+  glDisable(GL_LIGHTING);
+  glDisable(GL_FOG);
+  for (int i = 0; i < ClipPlaneSet::num_planes; i++)
+    glDisable(GL_CLIP_PLANE0 + i);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  compositeProgram.use();
+  glUniform1i(compositeProgram.getUniform("accum"), 0);
+  glUniform1i(compositeProgram.getUniform("reveal"), 1);
+  glUniform2f(compositeProgram.getUniform("size"), (float)width, (float)height);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, revealTexture);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, accumTexture);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glBegin(GL_QUADS);
+  glVertex2f(-1.0f, -1.0f);
+  glVertex2f( 1.0f, -1.0f);
+  glVertex2f( 1.0f,  1.0f);
+  glVertex2f(-1.0f,  1.0f);
+  glEnd();
+
+  glPopMatrix();
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+
+  ShaderProgram::useNone();
+  glPopAttrib();
+  SAVEGLERROR;
+#endif
+}
@@ -0,0 +1,77 @@
+#ifndef RGL_OIT_BUFFER_H
+#define RGL_OIT_BUFFER_H
+
+#include "RenderContext.h"
+#include "ShaderProgram.h"
+
+namespace rgl {
+
+class Material;
+
+//
+// CLASS
+//   OITBuffer
+//
+// Weighted blended order independent transparency (McGuire and Bavoil,
+// 2013).  Between begin() and end() transparent fragments are accumulated
+// in an offscreen framebuffer that shares the depth of the opaque scene;
+// end() composites the weighted average over the window.  Only the
+// fragment stage is replaced, so lighting and texture coordinates still
+// come from the fixed function vertex pipeline.  Needs OpenGL 3.0 for
+// framebuffer objects and float render targets.
+//
+
+class OITBuffer
+{
+public:
+  OITBuffer();
+  ~OITBuffer();
+
+  static bool isSupported();
+
+  /**
+   * can shapes with this material be accumulated?  Only the default
+   * blend function and modulate or replace texturing are emulated.
+   **/
+  static bool canDraw(Material* material);
+
+  /**
+   * start accumulating in the viewport; returns false if the caller
+   * should sort instead
+   **/
+  bool begin(RenderContext* renderContext, const Rect2& viewport);
+
+  /**
+   * set up texturing and fog for the material being drawn
+   **/
+  void useMaterial(Material* material);
+
+  /**
+   * composite the accumulated fragments over the scene
+   **/
+  void end(RenderContext* renderContext);
+
+  bool isActive() const { return active; }
+
+  /**
+   * free the buffers and programs while the context is still current
+   **/
+  void releaseGL();
+
+private:
+  bool resize(int in_width, int in_height);
+  void release();
+
+  bool active, failed;
+#ifndef RGL_NO_OPENGL
+  GLuint framebuffer, accumTexture, revealTexture, depthBuffer;
+  GLint  savedFramebuffer;
+#endif
+  int width, height;
+  Rect2 viewport;
+  ShaderProgram accumProgram, compositeProgram;
+};
+
+} // namespace rgl
+
+#endif // RGL_OIT_BUFFER_H
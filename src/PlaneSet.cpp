@@ -16,7 +16,8 @@ PlaneSet::PlaneSet(Material& in_material, int in_nnormal, double* in_normal, int
    TriangleSet(in_material,true, false/* true */),
    nPlanes(std::max(in_nnormal, in_noffset)),
    normal(in_nnormal, in_normal), 
-   offset(in_noffset, in_offset)
+   offset(in_noffset, in_offset),
+   trianglesValid(false)
 {
   /* We'll set up 4 triangles per plane, in case we need to render
      a hexagon.  Each triangle has 3 vertices (so 12 for the plane), and each vertex
@@ -61,15 +62,19 @@ AABox& PlaneSet::getBoundingBox(Subscene* subscene)
 
 void PlaneSet::renderBegin(RenderContext* renderContext)
 {
-  updateTriangles(renderContext->subscene);
-  invalidateDisplaylist();
+  if (updateTriangles(renderContext->subscene))
+    invalidateDisplaylist();
   TriangleSet::renderBegin(renderContext);
 }
 
-void PlaneSet::updateTriangles(Subscene* subscene)
+bool PlaneSet::updateTriangles(Subscene* subscene)
 {
   int perms[3][3] = { {0,0,1}, {1,2,2}, {2,1,0} };
   AABox sceneBBox = subscene->getBoundingBox();
+  if (trianglesValid && sceneBBox == triangleBBox)
+    return false;
+  triangleBBox = sceneBBox;
+  trianglesValid = true;
   double bbox[2][3] = { {sceneBBox.vmin.x, sceneBBox.vmin.y, sceneBBox.vmin.z},
                        {sceneBBox.vmax.x, sceneBBox.vmax.y, sceneBBox.vmax.z} };
   double x[12][3];
@@ -163,6 +168,7 @@ void PlaneSet::updateTriangles(Subscene* subscene)
       for (int j=0; j<3; j++) 
         setVertex(12*elem + 3*i + j, missing);
   }
+  return true;
 }
 
 int PlaneSet::getAttributeCount(SceneNode* subscene, AttribID attrib)
@@ -14,6 +14,8 @@ private:		/* Use parametrization ax + by + cz + d = 0 */
   int		nPlanes;
   ARRAY<Vertex> normal; /* (a,b,c) */
   ARRAY<float>  offset; /* d */  
+  AABox		triangleBBox;	/* the bounding box the triangles were clipped to */
+  bool		trianglesValid;
 public:
   PlaneSet(Material& in_material, int in_nnormal, double* in_normal, int in_noffset, double* in_offset);
   // ~PlaneSet();
@@ -34,9 +36,14 @@ public:
   virtual void renderBegin(RenderContext* renderContext);
 
   /**
-   * update mesh
+   * the triangles follow the bounding box
    */
-  void updateTriangles(Subscene* subscene);
+  virtual bool getCentersChange() { return true; }
+
+  /**
+   * update mesh if the bounding box has changed; returns whether it did
+   */
+  bool updateTriangles(Subscene* subscene);
   
   /**
    * update then get attributes 
@@ -0,0 +1,96 @@
+#include "PrimitiveBatch.h"
+
+#include "R.h"
+
+using namespace rgl;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CLASS
+//   PrimitiveBatch
+//
+
+// the merged arrays hold at most this many vertices
+#define BATCH_VERTICES 65536
+
+PrimitiveBatch::PrimitiveBatch()
+: type(0), nvertices(0), material(NULL), valid(false),
+  vertexBuffer(false), colorBuffer(false), indexBuffer(true)
+{
+  vertexBuffer.setEnabled(true);
+  colorBuffer.setEnabled(true);
+  indexBuffer.setEnabled(true);
+}
+
+bool PrimitiveBatch::add(PrimitiveSet* set)
+{
+  if (sets.empty()) {
+    type = set->getBatchType();
+    material = set->getMaterial();
+  } else if (set->getBatchType() != type
+          || set->getMaterial()->compareState(*material)
+          || nvertices + set->getVertexCount() > BATCH_VERTICES)
+    return false;
+  sets.push_back(set);
+  nvertices += set->getVertexCount();
+  boundingBox += set->getBoundingBox();
+  valid = false;
+  return true;
+}
+
+void PrimitiveBatch::build()
+{
+  vertices.clear();
+  colors.clear();
+  indices.clear();
+  vertices.reserve(3*nvertices);
+  colors.reserve(4*nvertices);
+  std::vector<PrimitiveSet*>::iterator iter;
+  for (iter = sets.begin(); iter != sets.end(); ++iter)
+    (*iter)->appendBatch(vertices, colors, indices);
+  vertexBuffer.invalidate();
+  colorBuffer.invalidate();
+  indexBuffer.invalidate();
+  valid = true;
+}
+
+/* The material of the first set supplies the state; the colours of
+   every set come from the merged colour array. */
+
+void PrimitiveBatch::render(RenderContext* renderContext)
+{
+#ifndef RGL_NO_OPENGL
+  if (!valid)
+    build();
+  if (indices.empty())
+    return;
+
+  material->beginUse(renderContext);
+  SAVEGLERROR;
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  if (vertexBuffer.bind(&vertices[0], vertices.size()*sizeof(float))) {
+    glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*) 0);
+    vertexBuffer.unbind();
+  } else
+    glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*) &vertices[0]);
+
+  glEnableClientState(GL_COLOR_ARRAY);
+  if (colorBuffer.bind(&colors[0], colors.size()*sizeof(u8))) {
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*) 0);
+    colorBuffer.unbind();
+  } else
+    glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*) &colors[0]);
+
+  bool buffered = indexBuffer.bind(&indices[0], indices.size()*sizeof(GLuint));
+  glDrawElements(type, indices.size(), GL_UNSIGNED_INT, buffered ? 0 : &indices[0]);
+  if (buffered)
+    indexBuffer.unbind();
+  SAVEGLERROR;
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  material->endUse(renderContext);
+  SAVEGLERROR;
+#endif
+}
@@ -0,0 +1,60 @@
+#ifndef RGL_PRIMITIVE_BATCH_H
+#define RGL_PRIMITIVE_BATCH_H
+
+#include <vector>
+
+#include "PrimitiveSet.h"
+
+namespace rgl {
+
+//
+// CLASS
+//   PrimitiveBatch
+//
+// Draws several small PrimitiveSets that share a primitive type and
+// material state with one set of arrays and one glDrawElements call.
+// The batch is only a way of drawing:  the sets stay in the scene and
+// keep their ids, so attributes, tags and pop3d work on them as before.
+// The subscene rebuilds its batches whenever its shape list changes;
+// until then the sets must not be deleted or modified.
+//
+
+class PrimitiveBatch
+{
+public:
+  PrimitiveBatch();
+
+  /**
+   * add a set, returning false if it doesn't match the others or
+   * the batch is full
+   **/
+  bool add(PrimitiveSet* set);
+
+  /**
+   * number of sets in the batch
+   **/
+  int size() const { return sets.size(); }
+
+  const AABox& getBoundingBox() const { return boundingBox; }
+  Material* getMaterial() { return material; }
+
+  void render(RenderContext* renderContext);
+
+private:
+  void build();
+
+  std::vector<PrimitiveSet*> sets;
+  int type;
+  int nvertices;
+  Material* material;	/* that of the first set */
+  AABox boundingBox;
+  bool valid;
+  std::vector<float> vertices;
+  std::vector<u8> colors;
+  std::vector<GLuint> indices;
+  BufferObject vertexBuffer, colorBuffer, indexBuffer;
+};
+
+} // namespace rgl
+
+#endif // RGL_PRIMITIVE_BATCH_H
@@ -3,8 +3,19 @@
 #include "subscene.h"
 #include "R.h"
 
+#include <algorithm>
+#include <cstring>
+
 using namespace rgl;
 
+// sets with at least this many primitives are split into chunks of
+// CHUNK_SIZE primitives
+#define CHUNK_MIN  65536
+#define CHUNK_SIZE 4096
+
+// sets with at most this many vertices may be batched with others
+#define BATCH_MAX 1024
+
 // ===[ PRIMITIVE SET ]=======================================================
 
 PrimitiveSet::PrimitiveSet (
@@ -15,12 +26,31 @@ PrimitiveSet::PrimitiveSet (
     bool in_ignoreExtent,
     bool in_bboxChange
     ) :
-Shape(in_material, in_ignoreExtent, SHAPE, in_bboxChange)
+Shape(in_material, in_ignoreExtent, SHAPE, in_bboxChange),
+indexBuffer(true),
+compactBuffer(true),
+chunkBuffer(true)
 {
   type                = in_type;
   nverticesperelement = in_nverticesperelement;
   nvertices           = 0;
+  hasmissing          = false;
   nindices            = 0;
+  initBufferObjects();
+}
+
+void PrimitiveSet::initBufferObjects()
+{
+  vertexArray.useBufferObject(true);
+  verticesTodraw.useBufferObject(true);
+  material.colors.useBufferObject(true);
+  indexBuffer.setEnabled(true);
+  indexBuffered = false;
+  compactBuffer.setEnabled(true);
+  compactValid = false;
+  marginValid = false;
+  chunkBuffer.setEnabled(true);
+  chunksValid = false;
 }
 
 void PrimitiveSet::initPrimitiveSet(
@@ -51,6 +81,10 @@ void PrimitiveSet::initPrimitiveSet(
     }
   } else
     indices = NULL;
+  indexBuffer.invalidate();
+  compactValid = false;
+  marginValid = false;
+  chunksValid = false;
 }
 
 PrimitiveSet::PrimitiveSet (
@@ -66,7 +100,10 @@ PrimitiveSet::PrimitiveSet (
 
 )
   :
-Shape(in_material, in_ignoreExtent, SHAPE, in_bboxChange)
+Shape(in_material, in_ignoreExtent, SHAPE, in_bboxChange),
+indexBuffer(true),
+compactBuffer(true),
+chunkBuffer(true)
 {
   type                = in_type;
   nverticesperelement = in_nverticesperelement;
@@ -95,6 +132,7 @@ Shape(in_material, in_ignoreExtent, SHAPE, in_bboxChange)
     }
   } else
     indices = NULL;
+  initBufferObjects();
 }
 
 PrimitiveSet::~PrimitiveSet () 
@@ -116,45 +154,264 @@ void PrimitiveSet::drawBegin(RenderContext* renderContext)
     bboxdeco = subscene->get_bboxdeco();
   }
   if (bboxdeco) {
-    invalidateDisplaylist();
-    verticesTodraw.alloc(vertexArray.size());
-    for (int i=0; i < vertexArray.size(); i++)
-      verticesTodraw.setVertex(i, bboxdeco->marginVecToDataVec(vertexArray[i], renderContext, &material) );
+    /* a display list can't notice when the margin moves */
+    if (!hasBufferObjects())
+      invalidateDisplaylist();
+    MarginTransform current = bboxdeco->getMarginTransform(renderContext, &material);
+    if (!marginValid || current != margin) {
+      margin = current;
+      if (verticesTodraw.size() != vertexArray.size())
+        verticesTodraw.alloc(vertexArray.size());
+      for (int i=0; i < vertexArray.size(); i++)
+        verticesTodraw.setVertex(i, margin.apply(vertexArray[i]) );
+      marginValid = true;
+    }
     verticesTodraw.beginUse();
   } else
     vertexArray.beginUse();
+  indexBuffered = nindices && indexBuffer.bind(indices, nindices*sizeof(GLuint));
+  if (!chunksValid)
+    initChunks();
   SAVEGLERROR;
 }
 
+// ---------------------------------------------------------------------------
+// The depth sorted path calls drawBegin for every run of primitives,
+// so the chunks are culled here, once per frame.
+
+void PrimitiveSet::renderBegin(RenderContext* renderContext)
+{
+  if (!chunksValid)
+    initChunks();
+  if (useChunks())
+    cullChunks(renderContext);
+}
+
+// ---------------------------------------------------------------------------
+// List the vertices of the primitives that have no missing vertices.
+// Line strips become separate segments, so gaps need no restart.
+
+void PrimitiveSet::appendCompactIndices(std::vector<GLuint>& out, GLuint base)
+{
+  int n = nindices ? nindices : nvertices;
+  if (type == GL_LINE_STRIP) {
+    for (int i=0; i < n-1; i++) {
+      GLuint elt0 = nindices ? indices[i] : i, 
+             elt1 = nindices ? indices[i+1] : i+1;
+      if (!vertexArray[elt0].missing() && !vertexArray[elt1].missing()) {
+        out.push_back(base + elt0);
+        out.push_back(base + elt1);
+      }
+    }
+  } else {
+    for (int i=0; i < nprimitives; i++) {
+      int idx = i*nverticesperelement;
+      bool skip = false;
+      for (int j=0; j<nverticesperelement && !skip; j++)
+        skip = vertexArray[nindices ? indices[idx + j] : idx + j].missing();
+      if (!skip)
+        for (int j=0; j<nverticesperelement; j++)
+          out.push_back(base + (nindices ? indices[idx + j] : idx + j));
+    }
+  }
+}
+
+void PrimitiveSet::initCompactIndices()
+{
+  compactIndices.clear();
+  appendCompactIndices(compactIndices, 0);
+  compactBuffer.invalidate();
+  compactValid = true;
+}
+
+// ---------------------------------------------------------------------------
+// Sets small enough that drawing them costs less than the calls to
+// set them up, whose vertices never move, can share a PrimitiveBatch.
+// Blended sets are sorted by primitive, so they stay separate.
+
+bool PrimitiveSet::isBatchable()
+{
+  return nvertices <= BATCH_MAX && material.marginCoord < 0 && !getBBoxChanges()
+      && !material.isTransparent() && !material.texture.get()
+      && material.colors.getLength() > 0;
+}
+
+void PrimitiveSet::appendBatch(std::vector<float>& vertices, std::vector<u8>& colors,
+                               std::vector<GLuint>& batchIndices)
+{
+  GLuint base = vertices.size()/3;
+  int ncolor = material.colors.getLength();
+  bool perVertex = material.useColorArray && ncolor > 1;
+  for (int i=0; i < nvertices; i++) {
+    Vertex v = vertexArray[i];
+    vertices.push_back(v.x);
+    vertices.push_back(v.y);
+    vertices.push_back(v.z);
+    const u8* color = material.colors.getColorPtr(perVertex ? i % ncolor : 0);
+    colors.insert(colors.end(), color, color + 4);
+  }
+  appendCompactIndices(batchIndices, base);
+}
+
+// ---------------------------------------------------------------------------
+// Interleave the bits of three 10 bit integers
+
+static inline unsigned int spreadBits(unsigned int v)
+{
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v <<  8)) & 0x0300f00f;
+  v = (v | (v <<  4)) & 0x030c30c3;
+  v = (v | (v <<  2)) & 0x09249249;
+  return v;
+}
+
+static inline unsigned int mortonCode(Vertex v, Vertex lo, Vertex hi)
+{
+  unsigned int q[3];
+  for (int k = 0; k < 3; k++) {
+    float range = hi[k] - lo[k];
+    float t = range > 0.0f ? (v[k] - lo[k])/range : 0.0f;
+    q[k] = (unsigned int)(getMax(0.0f, getMin(1.0f, t))*1023.0f);
+  }
+  return spreadBits(q[0]) | (spreadBits(q[1]) << 1) | (spreadBits(q[2]) << 2);
+}
+
+// ---------------------------------------------------------------------------
+// Sort the complete primitives of large sets along a Morton curve
+// through the bounding box and cut the result into chunks, each with
+// its own bounding box.  Line strips share vertices between
+// primitives, so they are left alone.
+
+void PrimitiveSet::initChunks()
+{
+  chunks.clear();
+  chunkIndices.clear();
+  primitiveChunk.clear();
+  chunksValid = true;
+  if (nprimitives < CHUNK_MIN || type == GL_LINE_STRIP || !boundingBox.isValid())
+    return;
+  
+  long n = nprimitives;
+  std::vector<unsigned long long> keys(n);
+  AABox box = boundingBox;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (long i = 0; i < n; i++) {
+    bool skip = false;
+    for (int j=0; j<nverticesperelement && !skip; j++) {
+      int idx = i*nverticesperelement + j;
+      skip = vertexArray[nindices ? indices[idx] : idx].missing();
+    }
+    /* missing primitives sort last and are dropped */
+    unsigned long long code = skip ? 0xffffffffULL : mortonCode(getCenter(i), box.vmin, box.vmax);
+    keys[i] = (code << 32) | (unsigned long long)i;
+  }
+  std::sort(keys.begin(), keys.end());
+  
+  if (isBlended())
+    primitiveChunk.assign(n, 0);
+  for (long i = 0; i < n; i++) {
+    if ((keys[i] >> 32) == 0xffffffffULL)
+      break;
+    if (i % CHUNK_SIZE == 0) {
+      Chunk chunk;
+      chunk.first = chunkIndices.size();
+      chunk.count = 0;
+      chunks.push_back(chunk);
+    }
+    Chunk& chunk = chunks.back();
+    int prim = (int)(keys[i] & 0xffffffffULL);
+    for (int j=0; j<nverticesperelement; j++) {
+      int idx = prim*nverticesperelement + j;
+      GLuint elt = nindices ? indices[idx] : idx;
+      chunkIndices.push_back(elt);
+      chunk.box += vertexArray[elt];
+    }
+    chunk.count += nverticesperelement;
+    if (isBlended())
+      primitiveChunk[prim] = chunks.size() - 1;
+  }
+  chunkVisible.assign(chunks.size(), 1);
+  /* no matrix has these, so the first cull always runs */
+  for (int i = 0; i < 16; i++)
+    chunkCulled[i] = NA_REAL;
+  chunkBuffer.invalidate();
+}
+
+// ---------------------------------------------------------------------------
+// Only the view volume is checked:  the modelMatrix may belong to a
+// sprite, where the subscene's clip planes don't apply directly.
+// Nothing is done if the matrices haven't changed since the last cull.
+
+void PrimitiveSet::cullChunks(RenderContext* renderContext)
+{
+  Subscene* subscene = renderContext->subscene;
+  Matrix4x4 M = Matrix4x4(subscene->projMatrix)*Matrix4x4(subscene->modelMatrix);
+  double data[16];
+  M.getData(data);
+  if (!memcmp(data, chunkCulled, sizeof(data)))
+    return;
+  memcpy(chunkCulled, data, sizeof(data));
+  for (size_t c = 0; c < chunks.size(); c++)
+    chunkVisible[c] = !chunks[c].box.isOutside(M);
+}
+
+// ---------------------------------------------------------------------------
+// Draw runs of adjacent visible chunks with one call each
+
+void PrimitiveSet::drawChunks()
+{
+#ifndef RGL_NO_OPENGL
+  if (chunkIndices.empty())
+    return;
+  bool buffered = chunkBuffer.bind(&chunkIndices[0], chunkIndices.size()*sizeof(GLuint));
+  const GLuint* base = buffered ? 0 : &chunkIndices[0];
+  size_t c = 0;
+  while (c < chunks.size()) {
+    if (!chunkVisible[c]) {
+      c++;
+      continue;
+    }
+    int first = chunks[c].first, count = 0;
+    while (c < chunks.size() && chunkVisible[c])
+      count += chunks[c++].count;
+    glDrawElements(type, count, GL_UNSIGNED_INT, base + first);
+  }
+  if (buffered)
+    chunkBuffer.unbind();
+  if (indexBuffered)
+    indexBuffer.bind(indices, nindices*sizeof(GLuint));
+#endif
+}
+
 // ---------------------------------------------------------------------------
 
 void PrimitiveSet::drawAll(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL
-  if (!hasmissing) {
+  if (useChunks()) {
+    /* sprites draw their shapes once per sprite with its own matrix */
+    cullChunks(renderContext);
+    drawChunks();
+  } else if (!hasmissing) {
     if (!nindices)
       glDrawArrays(type, 0, nverticesperelement*nprimitives );
     else
-      glDrawElements(type, nindices, GL_UNSIGNED_INT, indices);
+      glDrawElements(type, nindices, GL_UNSIGNED_INT, indexPointer(0));
   } else {
-    bool missing = true;
-    for (int i=0; i<nprimitives; i++) {
-      bool skip = false;
-      int elt = nindices ? indices[nverticesperelement*i] :
-                                   nverticesperelement*i;
-      for (int j=0; j<nverticesperelement; j++)
-        skip |= vertexArray[elt + j].missing();
-      if (missing != skip) {
-        missing = !missing;
-        if (missing) glEnd();
-        else glBegin(type);
-      }
-      if (!missing) 
-        for (int j=0; j<nverticesperelement; j++) {
-          glArrayElement( elt + j);
-        }
-    }
-    if (!missing) glEnd();
+    if (!compactValid)
+      initCompactIndices();
+    if (compactIndices.empty())
+      return;
+    bool buffered = compactBuffer.bind(&compactIndices[0], compactIndices.size()*sizeof(GLuint));
+    glDrawElements(type == GL_LINE_STRIP ? GL_LINES : type, compactIndices.size(),
+                   GL_UNSIGNED_INT, buffered ? 0 : &compactIndices[0]);
+    if (buffered)
+      compactBuffer.unbind();
+    if (indexBuffered)
+      indexBuffer.bind(indices, nindices*sizeof(GLuint));
   }              
 #endif
 }
@@ -164,6 +421,8 @@ void PrimitiveSet::drawAll(RenderContext* renderContext)
 void PrimitiveSet::drawPrimitive(RenderContext* renderContext, int index)
 {
 #ifndef RGL_NO_OPENGL
+  if (!primitiveChunk.empty() && useChunks() && !chunkVisible[primitiveChunk[index]])
+    return;
   int idx = index*nverticesperelement;
   if (hasmissing) {
     bool skip = false;
@@ -174,7 +433,7 @@ void PrimitiveSet::drawPrimitive(RenderContext* renderContext, int index)
     }
   }
   if (nindices)
-    glDrawElements(type, nverticesperelement, GL_UNSIGNED_INT, indices + idx);
+    glDrawElements(type, nverticesperelement, GL_UNSIGNED_INT, indexPointer(idx));
   else
     glDrawArrays(type, idx, nverticesperelement);
 #endif
@@ -184,6 +443,10 @@ void PrimitiveSet::drawPrimitive(RenderContext* renderContext, int index)
 
 void PrimitiveSet::drawEnd(RenderContext* renderContext)
 {
+  if (indexBuffered) {
+    indexBuffer.unbind();
+    indexBuffered = false;
+  }
   vertexArray.endUse();
   SAVEGLERROR;
   material.endUse(renderContext);
@@ -191,20 +454,6 @@ void PrimitiveSet::drawEnd(RenderContext* renderContext)
   Shape::drawEnd(renderContext);
 }
 
-// ---------------------------------------------------------------------------
-
-void PrimitiveSet::draw(RenderContext* renderContext)
-{
-  drawBegin(renderContext);
-  SAVEGLERROR;
-
-  drawAll(renderContext);
-  SAVEGLERROR;
-  
-  drawEnd(renderContext);
-  SAVEGLERROR;
-}
-
 int PrimitiveSet::getAttributeCount(SceneNode* subscene, AttribID attrib)
 {
   switch (attrib) {
@@ -270,6 +519,7 @@ FaceSet::FaceSet(
       texCoordArray[i].t = (float) in_texcoords[i*2+1];      
     }
   }
+  initBufferObjects();
 }
 
 FaceSet::FaceSet(Material& in_material, 
@@ -280,6 +530,15 @@ FaceSet::FaceSet(Material& in_material,
     ) :
   PrimitiveSet(in_material, in_type, in_nverticesperelement, in_ignoreExtent,in_bboxChange)
 { 
+  initBufferObjects();
+}
+
+void FaceSet::initBufferObjects()
+{
+  normalArray.useBufferObject(true);
+  normalsToDraw.useBufferObject(true);
+  texCoordArray.useBufferObject(true);
+  normalMarginValid = false;
 }
 
 void FaceSet::initFaceSet(
@@ -307,6 +566,7 @@ void FaceSet::initFaceSet(
 void FaceSet::initNormals(double* in_normals)
 {
   normalArray.alloc(nvertices);
+  normalMarginValid = false;
   if (in_normals) {
     for(int i=0;i<nvertices;i++) {
       normalArray[i].x = (float) in_normals[i*3+0];
@@ -342,6 +602,7 @@ void FaceSet::initNormals(double* in_normals)
     for (int i=0; i < nvertices; i++)
       normalArray[i].normalize();
   }
+  normalArray.invalidateBuffer();
 }
 
 // ---------------------------------------------------------------------------
@@ -360,9 +621,15 @@ void FaceSet::drawBegin(RenderContext* renderContext)
       bboxdeco = subscene->get_bboxdeco();
     }
     if (bboxdeco) {
-      normalsToDraw.alloc(normalArray.size());
-      for (int i=0; i < normalArray.size(); i++)
-        normalsToDraw.setVertex(i, bboxdeco->marginNormalToDataNormal(normalArray[i], renderContext, &material) );
+      MarginTransform current = bboxdeco->getMarginTransform(renderContext, &material);
+      if (!normalMarginValid || current != normalMargin) {
+        normalMargin = current;
+        if (normalsToDraw.size() != normalArray.size())
+          normalsToDraw.alloc(normalArray.size());
+        for (int i=0; i < normalArray.size(); i++)
+          normalsToDraw.setVertex(i, normalMargin.applyNormal(normalArray[i]) );
+        normalMarginValid = true;
+      }
       normalsToDraw.beginUse();
     } else
       normalArray.beginUse();
@@ -4,6 +4,7 @@
 #include "Shape.h"
 
 #include "render.h"
+#include "BBoxDeco.h"
 
 #include <map>
 
@@ -16,10 +17,6 @@ namespace rgl {
 
 class PrimitiveSet : public Shape {
 public:
-  /**
-   * overloaded
-   **/
-  virtual void draw(RenderContext* renderContext);
   /**
    * overloaded
    **/
@@ -36,6 +33,34 @@ public:
    **/
   virtual Vertex getPrimitiveCenter(int item) { return getCenter(item); }
 
+  /**
+   * overloaded:  sets draw straight from buffer objects
+   **/
+  virtual bool hasBufferObjects() { return BufferObject::isSupported(); }
+
+  /**
+   * overloaded:  small static opaque sets may be merged
+   **/
+  virtual bool isBatchable();
+
+  /**
+   * the primitive type when batched
+   **/
+  int getBatchType() const { return type == GL_LINE_STRIP ? GL_LINES : type; }
+  int getVertexCount() const { return nvertices; }
+
+  /**
+   * append the vertices, their colours and the complete primitives
+   * to the arrays of a batch
+   **/
+  void appendBatch(std::vector<float>& vertices, std::vector<u8>& colors,
+                   std::vector<GLuint>& batchIndices);
+
+  /**
+   * cull the chunks of a large set once per frame
+   **/
+  virtual void renderBegin(RenderContext* renderContext);
+
   /**
    * begin sending primitives 
    * interface
@@ -48,6 +73,12 @@ public:
    **/
   virtual void drawPrimitive(RenderContext* renderContext, int index);
   
+  /**
+   * send all elements
+   * interface
+   **/
+  virtual void drawAll(RenderContext* renderContext);
+  
   /**
    * end sending primitives
    * interface
@@ -57,7 +88,13 @@ public:
   /**
    * set a vertex
    **/
-  const void setVertex(int index, double* v) { vertexArray.setVertex(index, v); }
+  void setVertex(int index, double* v) { 
+    vertexArray.setVertex(index, v); 
+    hasmissing |= vertexArray[index].missing();
+    compactValid = false;
+    marginValid = false;
+    chunksValid = false;
+  }
 
   /**
    * setup all vertices
@@ -108,15 +145,6 @@ protected:
     return accu * ( 1.0f / ( (float) nverticesperelement ) );
   }
 
-  // ---[ PRIMITIVE DRAW INTERFACE ]------------------------------------------
-
-  
-  /**
-   * send all elements
-   * interface
-   **/
-  virtual void drawAll(RenderContext* renderContext);
-  
   void initPrimitiveSet (
       int in_nvertices, 
       double* vertex, 
@@ -133,8 +161,51 @@ protected:
   VertexArray vertexArray,  /* the vertices given by the user */
               verticesTodraw; /* the margin vertices in data coords */
   bool hasmissing; 	/* whether any vertices contain missing values */
+  MarginTransform margin;	/* the transform used for verticesTodraw */
+  bool marginValid;
   int nindices;
   unsigned int* indices;
+  BufferObject indexBuffer;
+  bool indexBuffered;	/* whether indexBuffer is bound between drawBegin and drawEnd */
+  std::vector<GLuint> compactIndices;	/* the primitives without missing vertices */
+  bool compactValid;
+  BufferObject compactBuffer;
+  
+  /* Large sets are split into spatially coherent chunks, so that
+     parts out of view can be skipped */
+  struct Chunk {
+    AABox box;
+    int first, count;	/* range of chunkIndices */
+  };
+  std::vector<Chunk> chunks;
+  std::vector<GLuint> chunkIndices;	/* complete primitives in Morton order */
+  std::vector<unsigned int> primitiveChunk;	/* chunk of each primitive, if blended */
+  std::vector<char> chunkVisible;
+  double chunkCulled[16];	/* the matrix chunkVisible was found for */
+  bool chunksValid;
+  BufferObject chunkBuffer;
+  
+  bool useChunks() { 
+    return !chunks.empty() && material.marginCoord < 0 && hasBufferObjects(); 
+  }
+  
+  /**
+   * argument for glDrawElements to draw from the given index
+   **/
+  const void* indexPointer(int index) {
+    if (indexBuffered)
+      return (const void*) (index*sizeof(GLuint));
+    else
+      return (const void*) (indices + index);
+  }
+  
+private:
+  void initBufferObjects();
+  void appendCompactIndices(std::vector<GLuint>& out, GLuint base);
+  void initCompactIndices();
+  void initChunks();
+  void cullChunks(RenderContext* renderContext);
+  void drawChunks();
 };
 
 
@@ -159,6 +230,11 @@ public:
    * overloaded
    **/  
   virtual std::string getTypeName() { return "faces"; };  
+
+  /**
+   * overloaded:  normals are not merged
+   **/
+  virtual bool isBatchable() { return !material.lit && PrimitiveSet::isBatchable(); }
   
   int getAttributeCount(SceneNode* subscene, AttribID attrib);
   void getAttribute(SceneNode* subscene, AttribID attrib, int first, int count, double* result);
@@ -197,7 +273,11 @@ protected:
   /* set up normals */
   void initNormals(double* in_normals);
 private:
+  void initBufferObjects();
+
   NormalArray normalArray, normalsToDraw;
+  MarginTransform normalMargin;	/* the transform used for normalsToDraw */
+  bool normalMarginValid;
   TexCoordArray texCoordArray;
 };
 
@@ -4,6 +4,8 @@
 namespace rgl {
 class Subscene;
 class GLFont;
+class OITBuffer;
+class ShaderProgram;
 } // namespace rgl
 
 #include "rglmath.h"
@@ -22,6 +24,12 @@ public:
   , lastTime(0.0)
   , deltaTime(0.0)
   , gl2psActive(0)
+  , oit(0)
+  , spriteProgram(0)
+  , sphereProgram(0)
+  , glyphProgram(0)
+  , materialApplied(false)
+  , materialKeep(false)
   { }
   Subscene* subscene;
   Rect2   rect;  // This is the full window rectangle in pixels
@@ -32,6 +40,15 @@ public:
   double deltaTime;
 
   int gl2psActive;
+  OITBuffer* oit;  // order independent transparency, if available
+  ShaderProgram* spriteProgram;  // expands sprites on the GPU
+  ShaderProgram* sphereProgram;  // sphere impostors
+  ShaderProgram* glyphProgram;   // places text quads from a GlyphAtlas
+  
+  // Material state shared by consecutive opaque shapes, see
+  // Subscene::renderUnsorted
+  bool materialApplied;  // the previous shape left its state in place
+  bool materialKeep;     // leave this shape's state for the next one
 };
 
 } // namespace rgl
@@ -7,6 +7,7 @@
 //
 
 #include <string>
+#include <unordered_set>
 #include "types.h"
 #include "geom.h"
 
@@ -94,6 +95,14 @@ private:
  
 bool sameID(SceneNode* node, int id);
 
+/**
+ * ids of nodes removed together, see Scene::pop
+ */
+
+typedef std::unordered_set<ObjID> ObjIDSet;
+
+bool inIDSet(SceneNode* node, const ObjIDSet* ids);
+
 } // namespace rgl
 
 #endif // SCENENODE_H
@@ -0,0 +1,138 @@
+#include "ShaderProgram.h"
+
+#include "R.h"
+
+using namespace rgl;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CLASS
+//   ShaderProgram
+//
+
+ShaderProgram::ShaderProgram(const char* in_vertexSource, const char* in_fragmentSource)
+: vertexSource(in_vertexSource), fragmentSource(in_fragmentSource),
+#ifndef RGL_NO_OPENGL
+  program(0),
+#endif
+  failed(false)
+{
+}
+
+ShaderProgram::~ShaderProgram()
+{
+  release();
+}
+
+void ShaderProgram::release()
+{
+#ifndef RGL_NO_OPENGL
+  if (program)
+    glDeleteProgram(program);
+  program = 0;
+#endif
+}
+
+bool ShaderProgram::isSupported()
+{
+#ifndef RGL_NO_OPENGL
+  return GLAD_GL_VERSION_2_0 != 0;
+#else
+  return false;
+#endif
+}
+
+#ifndef RGL_NO_OPENGL
+static GLuint compileShader(GLenum type, const char* source)
+{
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  glCompileShader(shader);
+  GLint status;
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if (!status) {
+    char log[1024];
+    glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+    Rf_warning("shader compilation failed: %s", log);
+    glDeleteShader(shader);
+    shader = 0;
+  }
+  return shader;
+}
+#endif
+
+bool ShaderProgram::build()
+{
+#ifndef RGL_NO_OPENGL
+  GLuint vertex = 0, fragment = 0;
+  if (vertexSource && !(vertex = compileShader(GL_VERTEX_SHADER, vertexSource)))
+    return false;
+  if (fragmentSource && !(fragment = compileShader(GL_FRAGMENT_SHADER, fragmentSource))) {
+    if (vertex) glDeleteShader(vertex);
+    return false;
+  }
+  program = glCreateProgram();
+  if (vertex) glAttachShader(program, vertex);
+  if (fragment) glAttachShader(program, fragment);
+  glLinkProgram(program);
+  /* the program keeps the shaders alive while they are attached */
+  if (vertex) glDeleteShader(vertex);
+  if (fragment) glDeleteShader(fragment);
+  GLint status;
+  glGetProgramiv(program, GL_LINK_STATUS, &status);
+  if (!status) {
+    char log[1024];
+    glGetProgramInfoLog(program, sizeof(log), NULL, log);
+    Rf_warning("shader linking failed: %s", log);
+    glDeleteProgram(program);
+    program = 0;
+    return false;
+  }
+  SAVEGLERROR;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool ShaderProgram::use()
+{
+#ifndef RGL_NO_OPENGL
+  if (failed || !isSupported())
+    return false;
+  if (!program && !build()) {
+    failed = true;
+    return false;
+  }
+  glUseProgram(program);
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ShaderProgram::useNone()
+{
+#ifndef RGL_NO_OPENGL
+  if (isSupported())
+    glUseProgram(0);
+#endif
+}
+
+int ShaderProgram::getUniform(const char* name)
+{
+#ifndef RGL_NO_OPENGL
+  if (program)
+    return glGetUniformLocation(program, name);
+#endif
+  return -1;
+}
+
+int ShaderProgram::getAttribute(const char* name)
+{
+#ifndef RGL_NO_OPENGL
+  if (program)
+    return glGetAttribLocation(program, name);
+#endif
+  return -1;
+}
@@ -0,0 +1,66 @@
+#ifndef RGL_SHADER_PROGRAM_H
+#define RGL_SHADER_PROGRAM_H
+
+#include "opengl.h"
+
+namespace rgl {
+
+//
+// CLASS
+//   ShaderProgram
+//
+// A GLSL program that is compiled the first time it is used.  Either
+// source may be NULL, in which case that stage stays fixed function.
+// If GLSL is not available (OpenGL < 2.0, or the NULL device) or the
+// program does not compile, use() returns false and callers fall back
+// to the fixed function pipeline.
+//
+
+class ShaderProgram
+{
+public:
+  ShaderProgram(const char* in_vertexSource, const char* in_fragmentSource);
+  ~ShaderProgram();
+
+  static bool isSupported();
+
+  /**
+   * install the program, building it first if necessary
+   **/
+  bool use();
+
+  /**
+   * return to the fixed function pipeline
+   **/
+  static void useNone();
+
+  /**
+   * delete the program while its context is current; it is built
+   * again on the next use()
+   **/
+  void release();
+
+  /**
+   * locations; only valid after a successful use()
+   **/
+  int getUniform(const char* name);
+  int getAttribute(const char* name);
+
+private:
+  /* not copyable */
+  ShaderProgram(const ShaderProgram&);
+  ShaderProgram& operator=(const ShaderProgram&);
+
+  bool build();
+
+  const char* vertexSource;
+  const char* fragmentSource;
+#ifndef RGL_NO_OPENGL
+  GLuint program;
+#endif
+  bool failed;
+};
+
+} // namespace rgl
+
+#endif // RGL_SHADER_PROGRAM_H
@@ -43,19 +43,32 @@ void Shape::draw(RenderContext* renderContext)
   drawBegin(renderContext);
   SAVEGLERROR;
   
-  for(int i=0;i<getPrimitiveCount();i++) 
-    drawPrimitive(renderContext, i);
+  drawAll(renderContext);
     
   SAVEGLERROR;  
   drawEnd(renderContext);
   SAVEGLERROR;
 }
 
+void Shape::drawAll(RenderContext* renderContext)
+{
+  for(int i=0;i<getPrimitiveCount();i++) 
+    drawPrimitive(renderContext, i);
+}
+
 void Shape::render(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL
   renderBegin(renderContext);
   
+  if (hasBufferObjects()) {
+    if (doUpdate)
+      update(renderContext);
+    draw(renderContext);
+    SAVEGLERROR;
+    return;
+  }
+  
   if (displayList == 0)
     displayList = glGenLists(1);
     
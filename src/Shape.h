@@ -26,10 +26,30 @@ public:
   /**
    * render shape.
    * Default Implementation: uses z-buffer and a display list 
-   * that stores everything from a call to draw().  
+   * that stores everything from a call to draw(), unless the shape
+   * keeps its data in buffer objects.
    **/
   virtual void render(RenderContext* renderContext);
 
+  /**
+   * does draw() take its data from buffer objects?  If so, recording
+   * a display list would only duplicate them.
+   **/
+  virtual bool hasBufferObjects() { return false; }
+
+  /**
+   * is the material state set each time the shape is rendered, rather
+   * than replayed from a display list?  Only then can it be shared
+   * with the shape drawn before.
+   **/
+  virtual bool isDrawnDirectly() { return hasBufferObjects(); }
+
+  /**
+   * can the shape be drawn as part of a PrimitiveBatch?  Only
+   * PrimitiveSets say yes.
+   **/
+  virtual bool isBatchable() { return false; }
+
   /**
    * request update of node due to content change. 
    * This will result in a new 'recording' of the display list.
@@ -56,6 +76,12 @@ public:
    * this shows how the shape would be sized in the given context
    **/
   virtual AABox& getBoundingBox(Subscene* subscene) { return boundingBox; }
+
+  /**
+   * is everything drawn inside getBoundingBox(subscene), so that the
+   * shape can be skipped when that box is out of view?
+   **/
+  virtual bool isCullable() { return material.marginCoord < 0; }
   
   /**
    * obtain material
@@ -92,6 +118,12 @@ public:
   
   virtual Vertex getPrimitiveCenter(int index) { return boundingBox.getCenter(); }
 
+  /**
+   * can the primitive centers move from one rendering to the next,
+   * e.g. because they are recomputed from the scene bounding box?
+   **/
+  virtual bool getCentersChange() { return false; }
+
   /**
    * Starting to render the shape.  After this, the renderContext won't change until
    * the next call.  This will only be called once per rendering.
@@ -109,6 +141,11 @@ public:
    **/
   virtual void drawPrimitive(RenderContext* renderContext, int index) = 0;
 
+  /**
+   * send all items; must be called between drawBegin and drawEnd
+   **/
+  virtual void drawAll(RenderContext* renderContext);
+
   /**
    * end sending items
    **/
@@ -22,7 +22,9 @@ SphereMesh::SphereMesh()
   sections( 16 ),
   type( GLOBE ),
   genNormal(false),
-  genTexCoord(false)
+  genTexCoord(false),
+  indexBuffer(true),
+  indexBuffered(false)
 {
 }
 
@@ -52,6 +54,31 @@ void SphereMesh::setupMesh()
 
   if (genTexCoord)
     texCoordArray.alloc(nvertex);  
+    
+  // the quads of each section, in the order of a quad strip
+  
+  quadIndices.clear();
+  for(int i=0; i<sections; i++ ) {
+
+    int curr = i * (segments+1);
+    int next = curr + (segments+1);
+
+    for(int j=0;j<segments;j++) {
+      quadIndices.push_back( next + j );
+      quadIndices.push_back( curr + j );
+      quadIndices.push_back( curr + j + 1 );
+      quadIndices.push_back( next + j + 1 );
+    }
+  }
+  indexBuffer.invalidate();
+}
+
+void SphereMesh::useBufferObjects(bool in_use)
+{
+  vertexArray.useBufferObject(in_use);
+  normalArray.useBufferObject(in_use);
+  texCoordArray.useBufferObject(in_use);
+  indexBuffer.setEnabled(in_use);
 }
 
 void SphereMesh::setCenter(const Vertex& in_center)
@@ -118,6 +145,13 @@ void SphereMesh::update(const Vertex& scale)
 }
 
 void SphereMesh::draw(RenderContext* renderContext)
+{
+  beginMesh(renderContext);
+  drawMesh();
+  endMesh();
+}
+
+void SphereMesh::beginMesh(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL
   vertexArray.beginUse();
@@ -127,19 +161,27 @@ void SphereMesh::draw(RenderContext* renderContext)
 
   if (genTexCoord)
     texCoordArray.beginUse();
+  
+  indexBuffered = indexBuffer.bind(&quadIndices[0], quadIndices.size()*sizeof(unsigned int));
+#endif
+}
 
-  for(int i=0; i<sections; i++ ) {
-
-    int curr = i * (segments+1);
-    int next = curr + (segments+1);
+void SphereMesh::drawMesh()
+{
+#ifndef RGL_NO_OPENGL
+  glDrawElements(GL_QUADS, quadIndices.size(), GL_UNSIGNED_INT, 
+                 indexBuffered ? 0 : &quadIndices[0]);
+#endif
+}
 
-    glBegin(GL_QUAD_STRIP);
-    for(int j=0;j<=segments;j++) {
-      glArrayElement( next + j );
-      glArrayElement( curr + j );
-    }
-    glEnd();
+void SphereMesh::endMesh()
+{
+#ifndef RGL_NO_OPENGL
+  if (indexBuffered) {
+    indexBuffer.unbind();
+    indexBuffered = false;
   }
+  
   vertexArray.endUse();
 
   if (genNormal)
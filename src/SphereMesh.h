@@ -1,7 +1,10 @@
 #ifndef SPHERE_MESH_H
 #define SPHERE_MESH_H
 
+#include <vector>
+
 #include "render.h"
+#include "BufferObject.h"
 
 namespace rgl {
 
@@ -39,6 +42,20 @@ public:
 
   void draw(RenderContext* renderContext);
   
+  /**
+   * draw the whole mesh repeatedly:  beginMesh() sets up the arrays,
+   * then each drawMesh() draws the mesh under the current modelview
+   **/
+  void beginMesh(RenderContext* renderContext);
+  void drawMesh();
+  void endMesh();
+  
+  /**
+   * keep the mesh in buffer objects; only useful if it is not updated
+   * between draws
+   **/
+  void useBufferObjects(bool in_use);
+  
   void drawBegin(RenderContext* renderContext, bool endcap);
   void drawPrimitive(RenderContext* renderContext, int i);
   void drawEnd(RenderContext* renderContext);
@@ -64,6 +81,9 @@ private:
   Type   type;
   bool   genNormal;
   bool   genTexCoord;
+  std::vector<unsigned int> quadIndices;
+  BufferObject  indexBuffer;
+  bool          indexBuffered;
 
   void   setupMesh();
 };
@@ -1,9 +1,18 @@
 #include "SphereSet.h"
 #include "Viewpoint.h"
+#include "OITBuffer.h"
+#include "ClipPlane.h"
+#include "gl2ps.h"
 #include "R.h"
 
 using namespace rgl;
 
+/* Tessellations of whole spheres, and the largest radius in pixels
+   that each is used for */
+
+static const int   lodSegments[SPHERE_LODS] = { 8, 16, 32, 64 };
+static const float lodRadius[SPHERE_LODS - 1] = { 8.0f, 32.0f, 128.0f };
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CLASS
@@ -11,15 +20,20 @@ using namespace rgl;
 //
 
 SphereSet::SphereSet(Material& in_material, int in_ncenter, double* in_center, int in_nradius, double* in_radius,
-                     int in_ignoreExtent, bool in_fastTransparency)
+                     int in_ignoreExtent, bool in_fastTransparency, bool in_impostors)
  : Shape(in_material, in_ignoreExtent, SHAPE, true), 
    center(in_ncenter, in_center), 
    radius(in_nradius, in_radius),
    lastdrawn(-1),
    lastendcap(true),
-   fastTransparency(in_fastTransparency)
+   fastTransparency(in_fastTransparency),
+   impostors(in_impostors),
+   bboxScaled(false),
+   quadsValid(false),
+   useImpostors(false)
 {
   material.colorPerVertex(false);
+  quadBuffer.setEnabled(true);
 
   if (material.lit)
     sphereMesh.setGenNormal(true);
@@ -28,6 +42,9 @@ SphereSet::SphereSet(Material& in_material, int in_ncenter, double* in_center, i
 
   sphereMesh.setGlobe(16,16);
   
+  for (int i = 0; i < SPHERE_LODS; i++)
+    unitMeshReady[i] = false;
+  
   for (int i=0;i<center.size();i++)
     boundingBox += Sphere( center.get(i), radius.getRecycled(i) );
   
@@ -41,6 +58,11 @@ SphereSet::~SphereSet()
 AABox& SphereSet::getBoundingBox(Subscene* subscene)
 {
   Vertex scale = subscene->getModelViewpoint()->scale;
+  if (bboxScaled && scale.x == bboxScale.x && scale.y == bboxScale.y 
+      && scale.z == bboxScale.z)
+    return boundingBox;
+  bboxScale = scale;
+  bboxScaled = true;
   scale.x = 1.0f/scale.x;
   scale.y = 1.0f/scale.y;
   scale.z = 1.0f/scale.z;
@@ -58,6 +80,7 @@ void SphereSet::drawBegin(RenderContext* renderContext)
   Shape::drawBegin(renderContext);
   material.beginUse(renderContext);
   lastdrawn = -1;
+  useImpostors = impostors && beginImpostors(renderContext);
 }
 
 void SphereSet::drawPrimitive(RenderContext* renderContext, int index) 
@@ -68,21 +91,18 @@ void SphereSet::drawPrimitive(RenderContext* renderContext, int index)
     Subscene* subscene = renderContext->subscene;
     bboxdeco = subscene->get_bboxdeco();
   }
-  if (fastTransparency) {
-    if (bboxdeco) {
-      invalidateDisplaylist();
-      pt = bboxdeco->marginVecToDataVec(center.get(index), renderContext, &material);
-    } else
-      pt = center.get(index);
-    
-    if ( pt.missing() || ISNAN(radius.getRecycled(index)) ) return;
-    
-    material.useColor(index);
-    sphereMesh.setCenter( pt );
-    sphereMesh.setRadius( radius.getRecycled(index) );
-    sphereMesh.update( renderContext->subscene->getModelViewpoint()->scale );
-    sphereMesh.draw(renderContext);
-    
+  if (useImpostors) {
+    for (int j = 0; j < 4; j++)
+      pending.push_back(4*index + j);
+  } else if (fastTransparency || impostors) {
+    float r;
+    if (getSphere(renderContext, index, &pt, &r)) {
+      setupLOD(renderContext);
+      SphereMesh& mesh = getUnitMesh(getLOD(pt, r));
+      mesh.beginMesh(renderContext);
+      drawSphere(renderContext, index, pt, r, mesh);
+      mesh.endMesh();
+    }
   } else {
    int i1 = index / facets, i2 = index % facets;
    bool endcap = i2 < sphereMesh.getSegments() 
@@ -93,7 +113,7 @@ void SphereSet::drawPrimitive(RenderContext* renderContext, int index)
        invalidateDisplaylist();
        pt = bboxdeco->marginVecToDataVec(center.get(i1), renderContext, &material);
      } else
-       pt = center.get(index);
+       pt = center.get(i1);
      if ( pt.missing() || ISNAN(radius.getRecycled(i1)) ) return;
 
      material.useColor(i1);
@@ -116,8 +136,137 @@ void SphereSet::drawPrimitive(RenderContext* renderContext, int index)
   }
 }
 
+/* Center and radius of a sphere; false if it is missing */
+
+bool SphereSet::getSphere(RenderContext* renderContext, int index, Vertex* pt, float* r)
+{
+  BBoxDeco* bboxdeco = 0;
+  if (material.marginCoord >= 0) {
+    Subscene* subscene = renderContext->subscene;
+    bboxdeco = subscene->get_bboxdeco();
+  }
+  if (bboxdeco) {
+    invalidateDisplaylist();
+    *pt = bboxdeco->marginVecToDataVec(center.get(index), renderContext, &material);
+  } else
+    *pt = center.get(index);
+  
+  *r = radius.getRecycled(index);
+  return !pt->missing() && !ISNAN(*r);
+}
+
+/* Draw the unit mesh scaled to one sphere.  The scale of the
+   subscene is undone so that the sphere appears round; normals
+   follow since GL_NORMALIZE is on.  Must be called between
+   mesh.beginMesh and endMesh. */
+
+void SphereSet::drawSphere(RenderContext* renderContext, int index, const Vertex& pt, float r,
+                           SphereMesh& mesh)
+{
+#ifndef RGL_NO_OPENGL
+  Vertex scale = renderContext->subscene->getModelViewpoint()->scale;
+  material.useColor(index);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glTranslatef(pt.x, pt.y, pt.z);
+  glScalef(r/scale.x, r/scale.y, r/scale.z);
+  mesh.drawMesh();
+  glPopMatrix();
+#endif
+}
+
+SphereMesh& SphereSet::getUnitMesh(int level)
+{
+  SphereMesh& mesh = unitMesh[level];
+  if (!unitMeshReady[level]) {
+    if (material.lit)
+      mesh.setGenNormal(true);
+    if ( (material.texture) && (!material.texture->is_envmap() ) )
+      mesh.setGenTexCoord(true);
+    mesh.setGlobe(lodSegments[level], lodSegments[level]);
+    mesh.update();
+    mesh.useBufferObjects(true);
+    unitMeshReady[level] = true;
+  }
+  return mesh;
+}
+
+/* Save what getLOD needs from the current matrices:  the row giving
+   clip w, and the radius in pixels of a unit sphere at w = 1. */
+
+void SphereSet::setupLOD(RenderContext* renderContext)
+{
+  Subscene* subscene = renderContext->subscene;
+  Vertex scale = subscene->getModelViewpoint()->scale;
+  Matrix4x4 P(subscene->projMatrix);
+  Matrix4x4 M(subscene->modelMatrix);
+  lodWrow = (P*M).getRow(3);
+  Vec4 u = M*Vec4(1.0f/scale.x, 0.0f, 0.0f, 0.0f),
+       p = P*Vec4(0.0f, 1.0f, 0.0f, 0.0f);
+  lodFactor = sqrt(u.x*u.x + u.y*u.y + u.z*u.z)*fabs(p.y)*subscene->pviewport.height/2.0f;
+}
+
+int SphereSet::getLOD(const Vertex& pt, float r)
+{
+  float w = lodWrow*Vec4(pt.x, pt.y, pt.z, 1.0f);
+  if (w <= 0.0f)
+    return 1;
+  float pixels = r*lodFactor/w;
+  int level = 0;
+  while (level < SPHERE_LODS - 1 && pixels > lodRadius[level])
+    level++;
+  return level;
+}
+
+/* Spheres are grouped by level of detail, so that each mesh
+   is set up once. */
+
+void SphereSet::drawAll(RenderContext* renderContext)
+{
+#ifndef RGL_NO_OPENGL
+  if (useImpostors) {
+    glDrawArrays(GL_QUADS, 0, 4*getElementCount());
+    return;
+  }
+#endif
+  int n = getElementCount();
+  lods.resize(n);
+  setupLOD(renderContext);
+  for (int i = 0; i < n; i++) {
+    Vertex pt;
+    float r;
+    lods[i] = getSphere(renderContext, i, &pt, &r) ? getLOD(pt, r) : SPHERE_LODS;
+  }
+  for (int level = 0; level < SPHERE_LODS; level++) {
+    bool begun = false;
+    for (int i = 0; i < n; i++) 
+      if (lods[i] == level) {
+        Vertex pt;
+        float r;
+        getSphere(renderContext, i, &pt, &r);
+        SphereMesh& mesh = getUnitMesh(level);
+        if (!begun) {
+          mesh.beginMesh(renderContext);
+          begun = true;
+        }
+        drawSphere(renderContext, i, pt, r, mesh);
+      }
+    if (begun)
+      getUnitMesh(level).endMesh();
+  }
+}
+
 void SphereSet::drawEnd(RenderContext* renderContext)
 {
+#ifndef RGL_NO_OPENGL
+  if (useImpostors) {
+    if (pending.size())
+      glDrawElements(GL_QUADS, pending.size(), GL_UNSIGNED_INT, &pending[0]);
+    pending.clear();
+    endImpostors();
+    useImpostors = false;
+  }
+#endif
   if (lastdrawn >= 0)
     sphereMesh.drawEnd( renderContext );
   lastdrawn = -1;
@@ -134,12 +283,12 @@ void SphereSet::render(RenderContext* renderContext)
 
 int SphereSet::getPrimitiveCount()
 {
-  return (fastTransparency ? 1 : facets) * getElementCount();
+  return (fastTransparency || impostors ? 1 : facets) * getElementCount();
 }
 
 Vertex SphereSet::getPrimitiveCenter(int index)
 {
-  if (fastTransparency) {
+  if (fastTransparency || impostors) {
     return center.get(index);
   } else {
     int i1 = index / facets, i2 = index % facets;
@@ -161,7 +310,7 @@ int SphereSet::getAttributeCount(SceneNode* subscene, AttribID attrib)
   switch (attrib) {
     case RADII:    return radius.size();
     case VERTICES: return center.size();
-    case FLAGS:    return 2;    
+    case FLAGS:    return 3;    
   }
   return Shape::getAttributeCount(subscene, attrib);
 }
@@ -185,11 +334,211 @@ void SphereSet::getAttribute(SceneNode* subscene, AttribID attrib, int first, in
           *result++ = radius.get(first++);
         return;
       case FLAGS:
-        if (first == 0) *result++ = ignoreExtent;
-        *result++ = (double) fastTransparency;
+        if (first < 1) *result++ = ignoreExtent;
+        if (first < 2 && n > 1) *result++ = (double) fastTransparency;
+        if (n > 2) *result++ = (double) impostors;
         return;
     }  
     Shape::getAttribute(subscene, attrib, first, count, result);
   }
 }
 
+
+// Impostors draw each sphere as a quad facing the viewer, large enough
+// to cover its outline, and find the visible surface by intersecting
+// the eye ray with the sphere in the fragment shader.  The shader
+// writes the depth of the surface, evaluates the fixed function
+// lighting model per fragment, and tests the clip planes itself since
+// the quad's own vertices say nothing about the surface.
+
+const char* SphereSet::impostorVertexShader =
+"#version 120\n"
+"uniform vec3 scale;\n"
+"attribute vec3 corner;  // corner, radius\n"
+"varying vec3 eyePos;\n"
+"varying vec3 eyeCenter;\n"
+"varying float eyeRadius;\n"
+"void main() {\n"
+"  vec4 c = gl_ModelViewMatrix*gl_Vertex;\n"
+"  vec3 C = c.xyz/c.w;\n"
+"  float R = corner.z*length((gl_ModelViewMatrix*vec4(1.0/scale.x, 0.0, 0.0, 0.0)).xyz);\n"
+"  bool ortho = gl_ProjectionMatrix[2][3] == 0.0;\n"
+"  vec3 axis = ortho ? vec3(0.0, 0.0, 1.0) : -normalize(C);\n"
+"  float d = length(C), size = R;\n"
+"  if (!ortho)  /* radius of the tangent cone at the center */\n"
+"    size = d > R ? R*d/sqrt(d*d - R*R) : 0.0;\n"
+"  vec3 u = normalize(cross(abs(axis.y) < 0.99 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0), axis));\n"
+"  vec3 v = cross(axis, u);\n"
+"  eyePos = C + size*(corner.x*u + corner.y*v);\n"
+"  eyeCenter = C;\n"
+"  eyeRadius = R;\n"
+"  gl_Position = gl_ProjectionMatrix*vec4(eyePos, 1.0);\n"
+"  gl_FrontColor = gl_Color;\n"
+"  gl_BackColor = gl_Color;\n"
+"}\n";
+
+const char* SphereSet::impostorFragmentShader =
+"#version 120\n"
+"uniform bool lit;\n"
+"uniform bool lightEnabled[8];\n"
+"uniform bool clipEnabled[6];\n"
+"uniform int fogMode;   // 0 = none, 1 = linear, 2 = exp, 3 = exp2\n"
+"varying vec3 eyePos;\n"
+"varying vec3 eyeCenter;\n"
+"varying float eyeRadius;\n"
+"void main() {\n"
+"  bool ortho = gl_ProjectionMatrix[2][3] == 0.0;\n"
+"  vec3 O = ortho ? vec3(eyePos.xy, eyeCenter.z + eyeRadius) : vec3(0.0);\n"
+"  vec3 D = ortho ? vec3(0.0, 0.0, -1.0) : normalize(eyePos);\n"
+"  vec3 oc = O - eyeCenter;\n"
+"  float b = dot(oc, D), disc = b*b - dot(oc, oc) + eyeRadius*eyeRadius;\n"
+"  if (disc < 0.0) discard;\n"
+"  vec4 hit = vec4(O + (-b - sqrt(disc))*D, 1.0);\n"
+"  for (int i = 0; i < 6; i++)\n"
+"    if (clipEnabled[i] && dot(gl_ClipPlane[i], hit) < 0.0) discard;\n"
+"  vec4 clip = gl_ProjectionMatrix*hit;\n"
+"  gl_FragDepth = 0.5*(gl_DepthRange.diff*clip.z/clip.w + gl_DepthRange.near + gl_DepthRange.far);\n"
+"  vec4 color = gl_Color;\n"
+"  if (lit) {\n"
+"    vec3 N = (hit.xyz - eyeCenter)/eyeRadius;\n"
+"    vec4 sum = gl_FrontMaterial.emission + gl_FrontMaterial.ambient*gl_LightModel.ambient;\n"
+"    for (int i = 0; i < 8; i++)\n"
+"      if (lightEnabled[i]) {\n"
+"        vec4 pos = gl_LightSource[i].position;\n"
+"        vec3 L = normalize(pos.w == 0.0 ? pos.xyz : pos.xyz - hit.xyz);\n"
+"        float nl = max(dot(N, L), 0.0);\n"
+"        sum += gl_LightSource[i].ambient*gl_FrontMaterial.ambient\n"
+"             + nl*gl_LightSource[i].diffuse*gl_Color;\n"
+"        if (nl > 0.0) {\n"
+"          vec3 H = normalize(L + vec3(0.0, 0.0, 1.0));\n"
+"          sum += pow(max(dot(N, H), 0.0), gl_FrontMaterial.shininess)\n"
+"                 *gl_LightSource[i].specular*gl_FrontMaterial.specular;\n"
+"        }\n"
+"      }\n"
+"    color = vec4(clamp(sum.rgb, 0.0, 1.0), gl_Color.a);\n"
+"  }\n"
+"  if (fogMode != 0) {\n"
+"    float z = abs(hit.z), f;\n"
+"    if (fogMode == 1)\n"
+"      f = (gl_Fog.end - z)*gl_Fog.scale;\n"
+"    else if (fogMode == 2)\n"
+"      f = exp(-gl_Fog.density*z);\n"
+"    else\n"
+"      f = exp(-pow(gl_Fog.density*z, 2.0));\n"
+"    color.rgb = mix(gl_Fog.color.rgb, color.rgb, clamp(f, 0.0, 1.0));\n"
+"  }\n"
+"  gl_FragColor = color;\n"
+"}\n";
+
+/* Fill the per vertex data for the impostors.  Missing spheres get
+   radius zero, so their quads are degenerate. */
+
+void SphereSet::buildQuads(RenderContext* renderContext)
+{
+  BBoxDeco* bboxdeco = 0;
+  if (material.marginCoord >= 0)
+    bboxdeco = renderContext->subscene->get_bboxdeco();
+  int ncolor = material.colors.getLength();
+  quads.resize(4*center.size());
+  for (int index = 0; index < center.size(); index++) {
+    Vertex pt = center.get(index);
+    if (bboxdeco)
+      pt = bboxdeco->marginVecToDataVec(pt, renderContext, &material);
+    float r = radius.getRecycled(index);
+    if (pt.missing() || ISNAN(r)) {
+      pt = Vertex(0.0f, 0.0f, 0.0f);
+      r = 0.0f;
+    }
+    Color color = ncolor ? material.colors.getColor(index % ncolor) : Color();
+    for (int j = 0; j < 4; j++) {
+      QuadVertex& q = quads[4*index + j];
+      q.center[0] = pt.x;
+      q.center[1] = pt.y;
+      q.center[2] = pt.z;
+      q.corner[0] = (j == 1 || j == 2) ? 1.0f : -1.0f;
+      q.corner[1] = (j >= 2) ? 1.0f : -1.0f;
+      q.corner[2] = r;
+      for (int k = 0; k < 4; k++)
+        q.color[k] = (u8)(255.0f*color.data[k] + 0.5f);
+    }
+  }
+  quadBuffer.invalidate();
+  quadsValid = !bboxdeco;
+}
+
+/* Set up the impostor shaders.  Textures, gl2ps output and the OIT
+   pass need the mesh, as do more clip planes than the shader tests. */
+
+bool SphereSet::beginImpostors(RenderContext* renderContext)
+{
+#ifndef RGL_NO_OPENGL
+  ShaderProgram* program = renderContext->sphereProgram;
+  if (!program || material.texture || !center.size()
+      || ClipPlaneSet::num_planes > 6
+      || renderContext->gl2psActive != GL2PS_NONE
+      || (renderContext->oit && renderContext->oit->isActive())
+      || !program->use())
+    return false;
+
+  if (!quadsValid)
+    buildQuads(renderContext);
+
+  Vertex scale = renderContext->subscene->getModelViewpoint()->scale;
+  glUniform3f(program->getUniform("scale"), scale.x, scale.y, scale.z);
+  glUniform1i(program->getUniform("lit"), material.lit);
+  GLint enabled[8];
+  for (int i = 0; i < 8; i++)
+    enabled[i] = glIsEnabled(GL_LIGHT0 + i);
+  glUniform1iv(program->getUniform("lightEnabled"), 8, enabled);
+  for (int i = 0; i < 6; i++)
+    enabled[i] = glIsEnabled(GL_CLIP_PLANE0 + i);
+  glUniform1iv(program->getUniform("clipEnabled"), 6, enabled);
+  int fogMode = 0;
+  if (glIsEnabled(GL_FOG)) {
+    GLint mode;
+    glGetIntegerv(GL_FOG_MODE, &mode);
+    fogMode = mode == GL_LINEAR ? 1 : mode == GL_EXP ? 2 : 3;
+  }
+  glUniform1i(program->getUniform("fogMode"), fogMode);
+  
+  /* the shader clips the surface, not the quad */
+  glPushAttrib(GL_ENABLE_BIT);
+  for (int i = 0; i < 6; i++)
+    glDisable(GL_CLIP_PLANE0 + i);
+
+  cornerAttribute = program->getAttribute("corner");
+  const char* base = (const char*) &quads[0];
+  GLsizei stride = sizeof(QuadVertex);
+  bool buffered = quadBuffer.bind(base, quads.size()*sizeof(QuadVertex));
+  if (buffered)
+    base = 0;
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, base + offsetof(QuadVertex, center));
+  glEnableClientState(GL_COLOR_ARRAY);
+  glColorPointer(4, GL_UNSIGNED_BYTE, stride, base + offsetof(QuadVertex, color));
+  if (cornerAttribute >= 0) {
+    glEnableVertexAttribArray(cornerAttribute);
+    glVertexAttribPointer(cornerAttribute, 3, GL_FLOAT, GL_FALSE, stride,
+                          base + offsetof(QuadVertex, corner));
+  }
+  if (buffered)
+    quadBuffer.unbind();
+  SAVEGLERROR;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void SphereSet::endImpostors()
+{
+#ifndef RGL_NO_OPENGL
+  if (cornerAttribute >= 0)
+    glDisableVertexAttribArray(cornerAttribute);
+  glPopClientAttrib();
+  glPopAttrib();
+  ShaderProgram::useNone();
+  SAVEGLERROR;
+#endif
+}
@@ -1,23 +1,37 @@
 #ifndef SPHERESET_H
 #define SPHERESET_H
 
+#include <vector>
+
 #include "scene.h"
 #include "Shape.h"
 #include "SphereMesh.h"
+#include "BufferObject.h"
 
 namespace rgl {
 
+/* number of tessellations of whole spheres */
+#define SPHERE_LODS 4
+
 class SphereSet : public Shape {
 private:
   ARRAY<Vertex> center;
   ARRAY<float>  radius;
-  SphereMesh    sphereMesh;
+  SphereMesh    sphereMesh;   /* facets of the current sphere */
+  SphereMesh    unitMesh[SPHERE_LODS];  /* shared by whole spheres */
+  bool          unitMeshReady[SPHERE_LODS];
+  std::vector<unsigned char> lods;
+  Vec4          lodWrow;      /* choice of level of detail */
+  float         lodFactor;
   int           facets, lastdrawn;
   bool          lastendcap; 
   bool          fastTransparency;
+  bool          impostors;
+  Vertex        bboxScale;    /* the scale boundingBox was found for */
+  bool          bboxScaled;
 public:
   SphereSet(Material& in_material, int nsphere, double* center, int nradius, double* radius, 
-            int in_ignoreExtent, bool in_fastTransparency);
+            int in_ignoreExtent, bool in_fastTransparency, bool in_impostors = false);
   ~SphereSet();
 
   /**
@@ -39,7 +53,8 @@ public:
   Vertex getPrimitiveCenter(int index);
   
   /**
-   * Spheres appear as spheres, so their bbox depends on scaling
+   * Spheres appear as spheres, so their bbox depends on scaling; it is
+   * only recomputed when the scale changes
    **/
    
   virtual AABox& getBoundingBox(Subscene* subscene);
@@ -55,6 +70,16 @@ public:
    **/
   void drawPrimitive(RenderContext* renderContext, int index);
 
+  /**
+   * send all spheres, as transformed copies of the unit mesh
+   **/
+  void drawAll(RenderContext* renderContext);
+  
+  /**
+   * the unit mesh is scaled when drawn, so needs no display list
+   **/
+  virtual bool hasBufferObjects() { return BufferObject::isSupported(); }
+
   /**
    * end sending items
    **/
@@ -62,6 +87,36 @@ public:
 
   virtual std::string getTypeName() { return "spheres"; };
 
+  /**
+   * shaders ray casting spheres, see RenderContext::sphereProgram
+   **/
+  static const char* impostorVertexShader;
+  static const char* impostorFragmentShader;
+
+private:
+  bool getSphere(RenderContext* renderContext, int index, Vertex* pt, float* r);
+  void drawSphere(RenderContext* renderContext, int index, const Vertex& pt, float r, 
+                  SphereMesh& mesh);
+  SphereMesh& getUnitMesh(int level);
+  void setupLOD(RenderContext* renderContext);
+  int  getLOD(const Vertex& pt, float r);
+  
+  struct QuadVertex {
+    float center[3];
+    float corner[3];   /* corner, radius */
+    u8    color[4];
+  };
+  std::vector<QuadVertex>   quads;    /* impostor input, four per sphere */
+  bool                      quadsValid;
+  BufferObject              quadBuffer;
+  std::vector<unsigned int> pending;  /* quads to draw at drawEnd */
+  bool useImpostors;
+  int  cornerAttribute;
+  
+  void buildQuads(RenderContext* renderContext);
+  bool beginImpostors(RenderContext* renderContext);
+  void endImpostors();
+
 };
 
 } // namespace rgl
@@ -1,8 +1,11 @@
 
 #include "SpriteSet.h"
 #include "Shape.h"
+#include "OITBuffer.h"
+#include "gl2ps.h"
 #include "R.h"
 #include <algorithm>
+#include <functional>
 
 using namespace rgl;
 
@@ -27,8 +30,12 @@ SpriteSet::SpriteSet(Material& in_material, int in_nvertex, double* in_vertex, i
    offset(in_offset),
    fixedSize(in_fixedSize),
    rotating(in_rotating),
-   scene(in_scene)
+   scene(in_scene),
+   quadsValid(false),
+   useMargin(false),
+   useShader(false)
 { 
+  quadBuffer.setEnabled(true);
   if (!count)
     material.colorPerVertex(false);
   else {
@@ -115,6 +122,8 @@ void SpriteSet::drawBegin(RenderContext* renderContext)
   
   Shape::drawBegin(renderContext);
 
+  updateMargin(renderContext);
+
   m = Matrix4x4(renderContext->subscene->modelMatrix);
   
   if (fixedSize && !rotating) {
@@ -130,25 +139,63 @@ void SpriteSet::drawBegin(RenderContext* renderContext)
     doTex = (material.texture) ? true : false;
     glNormal3f(0.0f,0.0f,1.0f);
     material.beginUse(renderContext);
+    useShader = beginShader(renderContext);
   }
 #endif
 }
 
-void SpriteSet::drawPrimitive(RenderContext* renderContext, int index)
+/* Sprites in the margin are moved to data coordinates only when
+   the bounding box or the chosen edge has changed. */
+
+void SpriteSet::updateMargin(RenderContext* renderContext)
 {
-#ifndef RGL_NO_OPENGL
-  Vertex o;
   BBoxDeco* bboxdeco = 0;
-  if (material.marginCoord >= 0) {
-    Subscene* subscene = renderContext->subscene;
-    bboxdeco = subscene->get_bboxdeco();
-  }  
-  if (bboxdeco) 
-    o = bboxdeco->marginVecToDataVec(vertex.get(index), renderContext, &material);
-  else
-    o = vertex.get(index);
-  float   s = size.getRecycled(index);
-  if (o.missing() || ISNAN(s)) return;
+  if (material.marginCoord >= 0)
+    bboxdeco = renderContext->subscene->get_bboxdeco();
+  if (!bboxdeco) {
+    if (useMargin)
+      quadsValid = false;
+    useMargin = false;
+    return;
+  }
+  MarginTransform current = bboxdeco->getMarginTransform(renderContext, &material);
+  if (!useMargin || current != margin
+      || (int)marginCenters.size() != vertex.size()) {
+    margin = current;
+    marginCenters.resize(vertex.size());
+    for (int index = 0; index < vertex.size(); index++)
+      marginCenters[index] = margin.apply(vertex.get(index));
+    quadsValid = false;
+    useMargin = true;
+  }
+}
+
+/* Scaling of fixed size sprites */
+
+Vec3 SpriteSet::getFixedScale(RenderContext* renderContext)
+{
+  Subscene* subscene = renderContext->subscene;
+  float winwidth  = (float) subscene->pviewport.width;
+  float winheight = (float) subscene->pviewport.height;
+  // The magic number 27 is chosen so that plotmath3d matches text3d.
+  float scalex = 27.0f/winwidth, scaley = 27.0f/winheight;
+  if (!rotating)
+    return Vec3(scalex, scaley, (scalex + scaley)/2.0f);
+  UserViewpoint* userviewpoint = subscene->getUserViewpoint();
+  /* FIXME: The magic value below is supposed to approximate the non-rotating size. */
+  float zoom = userviewpoint->getZoom(),
+    scale = zoom * sqrt(scalex * scaley) * 4.0f;
+  return Vec3(scale, scale, scale);
+}
+
+/* Set the subscene's modelMatrix for one sprite, and return its
+   half size in s.  Returns false if the sprite isn't drawn. */
+
+bool SpriteSet::setSpriteMatrix(RenderContext* renderContext, int index, float* s)
+{
+  Vertex o = getCenter(index);
+  *s = size.getRecycled(index);
+  if (o.missing() || ISNAN(*s)) return false;
 
   Vec3 v3;
   /* We need to modify the variable rather than the GPU's
@@ -157,25 +204,16 @@ void SpriteSet::drawPrimitive(RenderContext* renderContext, int index)
   Matrix4x4 *modelMatrix = &renderContext->subscene->modelMatrix;
   
   if (fixedSize) {
-    Subscene* subscene = renderContext->subscene;
-    float winwidth  = (float) subscene->pviewport.width;
-    float winheight = (float) subscene->pviewport.height;
-    // The magic number 27 is chosen so that plotmath3d matches text3d.
-    float scalex = 27.0f/winwidth, scaley = 27.0f/winheight;
+    Vec3 scale = getFixedScale(renderContext);
     if (!rotating) {
       v3 =  p * (m * o);
       *modelMatrix = Matrix4x4::translationMatrix(v3.x, v3.y, v3.z)*
-                   Matrix4x4::scaleMatrix(scalex, scaley, (scalex + scaley)/2.0f);
-    } else {
-      UserViewpoint* userviewpoint = subscene->getUserViewpoint();
-      /* FIXME: The magic value below is supposed to approximate the non-rotating size. */
-      float zoom = userviewpoint->getZoom(),
-        scale = zoom * sqrt(scalex * scaley) * 4.0f;
+                   Matrix4x4::scaleMatrix(scale.x, scale.y, scale.z);
+    } else
       *modelMatrix = m * Matrix4x4::translationMatrix(o.x, o.y, o.z)*
-        Matrix4x4::scaleMatrix(scale, scale, scale);
-    }
+        Matrix4x4::scaleMatrix(scale.x, scale.y, scale.z);
   } else {
-    s = s * 0.5f;	
+    *s = *s * 0.5f;	
     if (!rotating) {
       v3 = m * o;
       *modelMatrix = Matrix4x4::translationMatrix(v3.x, v3.y, v3.z);
@@ -186,14 +224,30 @@ void SpriteSet::drawPrimitive(RenderContext* renderContext, int index)
   if (pos.size())
     getAdj(index);
   
-  if (shapes.size()) {
-    Shape::drawEnd(renderContext);  // The shape will call drawBegin/drawEnd
+  if (shapes.size())
     *modelMatrix = (*modelMatrix)*
-                   Matrix4x4::scaleMatrix(2*s,2*s,2*s)*
+                   Matrix4x4::scaleMatrix(2*(*s),2*(*s),2*(*s))*
                    Matrix4x4::translationMatrix((1.0 - 2.0*adj.x), 
                                                 (1.0 - 2.0*adj.y),
                                                 (1.0 - 2.0*adj.z))*
                    Matrix4x4(userMatrix);
+  return true;
+}
+
+void SpriteSet::drawPrimitive(RenderContext* renderContext, int index)
+{
+#ifndef RGL_NO_OPENGL
+  if (useShader) {
+    /* collect the quads; drawEnd sends them together */
+    for (int j = 0; j < 4; j++)
+      pending.push_back(4*index + j);
+    return;
+  }
+  float s;
+  if (!setSpriteMatrix(renderContext, index, &s)) return;
+
+  if (shapes.size()) {
+    Shape::drawEnd(renderContext);  // The shape will call drawBegin/drawEnd
 
     /* Since we modified modelMatrix, we need to reload it */
     renderContext->subscene->loadMatrices();    
@@ -239,6 +293,123 @@ void SpriteSet::drawPrimitive(RenderContext* renderContext, int index)
 #endif
 }
   
+/* Nested sprites cache the modelMatrix in drawBegin, so they
+   have to be started separately for each sprite. */
+
+bool SpriteSet::hasNestedSprites()
+{
+  for (std::vector<int>::iterator i = shapes.begin(); i != shapes.end() ; ++ i )
+    if (scene->get_shape(*i)->getTypeName() == "sprites")
+      return true;
+  return false;
+}
+
+void SpriteSet::drawAll(RenderContext* renderContext)
+{
+#ifndef RGL_NO_OPENGL
+  if (useShader) {
+    glDrawArrays(GL_QUADS, 0, 4*vertex.size());
+    return;
+  }
+  if (!shapes.size() || hasNestedSprites()) {
+    Shape::drawAll(renderContext);
+    return;
+  }
+  Subscene* subscene = renderContext->subscene;
+  int ngroups = static_cast<int>(shapefirst.size());
+  
+  Shape::drawEnd(renderContext);  // The shapes will call drawBegin/drawEnd
+  for (int j = 0; j < ngroups; j++) {
+    
+    /* Sprite index uses shape group index % ngroups; compute
+       their matrices once for all shapes in the group */
+    spriteMatrices.clear();
+    for (int index = j; index < vertex.size(); index += ngroups) {
+      float s;
+      if (setSpriteMatrix(renderContext, index, &s)) {
+        size_t k = spriteMatrices.size();
+        spriteMatrices.resize(k + 16);
+        subscene->modelMatrix.getData(&spriteMatrices[k]);
+      }
+    }
+    if (spriteMatrices.empty())
+      continue;
+    
+    int first = shapefirst.at(j);
+    for (int i = 0; i < shapelens.at(j) ; ++ i ) {
+      Shape* shape = scene->get_shape(shapes.at(first + i));
+      if (shape->isBatchable()) {
+        drawMerged(renderContext, static_cast<PrimitiveSet*>(shape));
+        continue;
+      }
+      subscene->loadMatrices();
+      shape->drawBegin(renderContext);
+      for (size_t k = 0; k < spriteMatrices.size(); k += 16) {
+        subscene->modelMatrix.loadData(&spriteMatrices[k]);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadMatrixd(&spriteMatrices[k]);
+        shape->drawAll(renderContext);
+      }
+      shape->drawEnd(renderContext);
+    }
+  }
+  Shape::drawBegin(renderContext);
+#endif
+}
+
+/* A template set that a PrimitiveBatch could hold is drawn for all the
+   sprites of a group with one call:  its vertices are moved into eye
+   coordinates by each sprite's matrix and sent under an identity
+   modelview. */
+
+void SpriteSet::drawMerged(RenderContext* renderContext, PrimitiveSet* shape)
+{
+#ifndef RGL_NO_OPENGL
+  shapeVertices.clear();
+  shapeColors.clear();
+  shapeIndices.clear();
+  shape->appendBatch(shapeVertices, shapeColors, shapeIndices);
+  size_t nv = shapeVertices.size()/3, ni = shapeIndices.size(),
+         nsprites = spriteMatrices.size()/16;
+  if (!ni)
+    return;
+  
+  mergedVertices.resize(4*nv*nsprites);
+  mergedColors.resize(4*nv*nsprites);
+  mergedIndices.resize(ni*nsprites);
+  for (size_t k = 0; k < nsprites; k++) {
+    const double* M = &spriteMatrices[16*k];
+    float* out = &mergedVertices[4*nv*k];
+    for (size_t v = 0; v < nv; v++) {
+      const float* in = &shapeVertices[3*v];
+      for (int r = 0; r < 4; r++)
+        out[4*v + r] = M[r]*in[0] + M[4 + r]*in[1] + M[8 + r]*in[2] + M[12 + r];
+    }
+    std::copy(shapeColors.begin(), shapeColors.end(), mergedColors.begin() + 4*nv*k);
+    GLuint base = nv*k;
+    for (size_t i = 0; i < ni; i++)
+      mergedIndices[ni*k + i] = shapeIndices[i] + base;
+  }
+  
+  Material* shapeMaterial = shape->getMaterial();
+  shapeMaterial->beginUse(renderContext);
+  /* drawBegin may have replaced the projection, and the sprite
+     matrices assume that it has */
+  renderContext->subscene->loadMatrices();
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(4, GL_FLOAT, 0, (const GLvoid*) &mergedVertices[0]);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glColorPointer(4, GL_UNSIGNED_BYTE, 0, (const GLvoid*) &mergedColors[0]);
+  glDrawElements(shape->getBatchType(), mergedIndices.size(), GL_UNSIGNED_INT, &mergedIndices[0]);
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  shapeMaterial->endUse(renderContext);
+  SAVEGLERROR;
+#endif
+}
+
 void SpriteSet::getAdj(int index)
 {
   int p = pos.get(index);
@@ -292,6 +463,13 @@ void SpriteSet::getAdj(int index)
 void SpriteSet::drawEnd(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL
+  if (useShader) {
+    if (pending.size())
+      glDrawElements(GL_QUADS, pending.size(), GL_UNSIGNED_INT, &pending[0]);
+    pending.clear();
+    endShader();
+    useShader = false;
+  }
   if (fixedSize) {
     renderContext->subscene->projMatrix = Matrix4x4(p);
   }
@@ -304,6 +482,150 @@ void SpriteSet::drawEnd(RenderContext* renderContext)
 #endif
 }
 
+// Billboards of plain sprites can be expanded by a vertex shader:  each
+// sprite is sent as four copies of its center, with the corner in the
+// texture coordinate and adj and size in the "sprite" attribute.  The
+// shader reproduces the matrices set up by setSpriteMatrix, including
+// the eye coordinates seen by clip planes and fog.
+
+const char* SpriteSet::vertexShader =
+"#version 120\n"
+"uniform mat4 modelMatrix;\n"
+"uniform mat4 projMatrix;\n"
+"uniform vec3 scale;\n"
+"uniform int fixedSize;\n"
+"uniform int rotating;\n"
+"attribute vec4 sprite;  // adj, size\n"
+"void main() {\n"
+"  vec2 corner = gl_MultiTexCoord0.xy;\n"
+"  float s = fixedSize != 0 ? sprite.w : 0.5*sprite.w;\n"
+"  vec3 local = scale*s*vec3(2.0*(corner - sprite.xy), 1.0 - 2.0*sprite.z);\n"
+"  vec4 eye;\n"
+"  if (rotating != 0)\n"
+"    eye = modelMatrix*vec4(gl_Vertex.xyz + local, 1.0);\n"
+"  else {\n"
+"    vec4 c = modelMatrix*vec4(gl_Vertex.xyz, 1.0);\n"
+"    if (fixedSize != 0)\n"
+"      c = projMatrix*vec4(c.xyz/c.w, 1.0);\n"
+"    eye = vec4(c.xyz/c.w + local, 1.0);\n"
+"  }\n"
+"  gl_ClipVertex = eye;\n"
+"  gl_Position = (fixedSize != 0 && rotating == 0) ? eye : projMatrix*eye;\n"
+"  gl_FrontColor = gl_Color;\n"
+"  gl_BackColor = gl_Color;\n"
+"  gl_TexCoord[0] = gl_TextureMatrix[0]*gl_MultiTexCoord0;\n"
+"  gl_FogFragCoord = abs(eye.z);\n"
+"}\n";
+
+/* Fill the per vertex data for the shader.  Missing sprites get size
+   zero, so their quads are degenerate and produce no fragments. */
+
+void SpriteSet::buildQuads(RenderContext* renderContext)
+{
+  int ncolor = material.colors.getLength();
+  quads.resize(4*vertex.size());
+  for (int index = 0; index < vertex.size(); index++) {
+    Vertex o = getCenter(index);
+    float s = size.getRecycled(index);
+    if (o.missing() || ISNAN(s)) {
+      o = Vertex(0.0f, 0.0f, 0.0f);
+      s = 0.0f;
+    }
+    if (pos.size())
+      getAdj(index);
+    Color color = ncolor ? material.colors.getColor(index % ncolor) : Color();
+    for (int j = 0; j < 4; j++) {
+      QuadVertex& q = quads[4*index + j];
+      q.center[0] = o.x;
+      q.center[1] = o.y;
+      q.center[2] = o.z;
+      q.corner[0] = (j == 1 || j == 2) ? 1.0f : 0.0f;
+      q.corner[1] = (j >= 2) ? 1.0f : 0.0f;
+      q.sprite[0] = adj.x;
+      q.sprite[1] = adj.y;
+      q.sprite[2] = adj.z;
+      q.sprite[3] = s;
+      for (int k = 0; k < 4; k++)
+        q.color[k] = (u8)(255.0f*color.data[k] + 0.5f);
+    }
+  }
+  quadBuffer.invalidate();
+  quadsValid = true;
+}
+
+/* Set up the shader if this set can use it; it can't emulate lighting
+   or sphere mapping, and isn't seen by gl2ps or the OIT pass. */
+
+bool SpriteSet::beginShader(RenderContext* renderContext)
+{
+#ifndef RGL_NO_OPENGL
+  ShaderProgram* program = renderContext->spriteProgram;
+  if (!program || material.lit || material.envmap || !vertex.size()
+      || renderContext->gl2psActive != GL2PS_NONE
+      || (renderContext->oit && renderContext->oit->isActive())
+      || !program->use())
+    return false;
+
+  if (!quadsValid)
+    buildQuads(renderContext);
+
+  double data[16];
+  float mdata[16], pdata[16];
+  m.getData(data);
+  for (int i = 0; i < 16; i++)
+    mdata[i] = (float)data[i];
+  if (fixedSize && !rotating)
+    p.getData(data);
+  else
+    renderContext->subscene->projMatrix.getData(data);
+  for (int i = 0; i < 16; i++)
+    pdata[i] = (float)data[i];
+  Vec3 scale = fixedSize ? getFixedScale(renderContext) : Vec3(1.0f, 1.0f, 1.0f);
+
+  glUniformMatrix4fv(program->getUniform("modelMatrix"), 1, GL_FALSE, mdata);
+  glUniformMatrix4fv(program->getUniform("projMatrix"), 1, GL_FALSE, pdata);
+  glUniform3f(program->getUniform("scale"), scale.x, scale.y, scale.z);
+  glUniform1i(program->getUniform("fixedSize"), fixedSize);
+  glUniform1i(program->getUniform("rotating"), rotating);
+
+  spriteAttribute = program->getAttribute("sprite");
+  const char* base = (const char*) &quads[0];
+  GLsizei stride = sizeof(QuadVertex);
+  bool buffered = quadBuffer.bind(base, quads.size()*sizeof(QuadVertex));
+  if (buffered)
+    base = 0;
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, base + offsetof(QuadVertex, center));
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glTexCoordPointer(2, GL_FLOAT, stride, base + offsetof(QuadVertex, corner));
+  glEnableClientState(GL_COLOR_ARRAY);
+  glColorPointer(4, GL_UNSIGNED_BYTE, stride, base + offsetof(QuadVertex, color));
+  if (spriteAttribute >= 0) {
+    glEnableVertexAttribArray(spriteAttribute);
+    glVertexAttribPointer(spriteAttribute, 4, GL_FLOAT, GL_FALSE, stride,
+                          base + offsetof(QuadVertex, sprite));
+  }
+  if (buffered)
+    quadBuffer.unbind();
+  SAVEGLERROR;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void SpriteSet::endShader()
+{
+#ifndef RGL_NO_OPENGL
+  if (spriteAttribute >= 0)
+    glDisableVertexAttribArray(spriteAttribute);
+  glPopClientAttrib();
+  ShaderProgram::useNone();
+  SAVEGLERROR;
+#endif
+}
+
 void SpriteSet::render(RenderContext* renderContext)
 { 
     draw(renderContext);
@@ -418,3 +740,15 @@ void SpriteSet::remove_shape(int id)
 {
   shapes.erase(std::remove(shapes.begin(), shapes.end(), id), shapes.end());
 }
+
+static bool idInSet(int id, const ObjIDSet* ids)
+{
+  return ids->count(id) > 0;
+}
+
+void SpriteSet::remove_shapes(const ObjIDSet& ids)
+{
+  shapes.erase(std::remove_if(shapes.begin(), shapes.end(),
+                              std::bind(&idInSet, std::placeholders::_1, &ids)),
+               shapes.end());
+}
@@ -3,7 +3,10 @@
 
 #include <vector>
 #include "Shape.h"
+#include "PrimitiveSet.h"
 #include "scene.h"
+#include "BufferObject.h"
+#include "BBoxDeco.h"
 
 namespace rgl {
 
@@ -37,6 +40,11 @@ public:
   
   virtual std::string getTypeName() { return "sprites"; };
   
+  /**
+   * sprite sizes may be in screen units, so the bounding box is only a guess
+   **/
+  virtual bool isCullable() { return false; }
+  
   virtual int getElementCount(void);
   int getAttributeCount(SceneNode* subscene, AttribID attrib);
   void getAttribute(SceneNode* subscene, AttribID attrib, int first, int count, double* result);
@@ -58,6 +66,13 @@ public:
    **/
   virtual void drawPrimitive(RenderContext* renderContext, int index);
   
+  /**
+   * send all items:  3D sprites draw each template shape for all
+   * sprites at once when it can, otherwise once per sprite between a
+   * single drawBegin/drawEnd
+   **/
+  virtual void drawAll(RenderContext* renderContext);
+  
   /**
    * end sending items
    **/
@@ -72,6 +87,12 @@ public:
    * delete a shape
    */
   void remove_shape(int id);
+  void remove_shapes(const ObjIDSet& ids);
+  
+  /**
+   * vertex shader expanding plain sprites, see RenderContext::spriteProgram
+   **/
+  static const char* vertexShader;
   
 private:
   GLdouble userMatrix[16]; /* Transformation for 3D sprites */
@@ -85,7 +106,37 @@ private:
   bool rotating;
   Scene* scene;
   Vec3 adj;
+  std::vector<double> spriteMatrices; /* Modelview matrices of one shape group */
+  std::vector<float>  shapeVertices, mergedVertices; /* see drawMerged */
+  std::vector<u8>     shapeColors, mergedColors;
+  std::vector<GLuint> shapeIndices, mergedIndices;
+  std::vector<Vertex> marginCenters;  /* centers in data coordinates for margin sprites */
+  MarginTransform margin;             /* the transform used for marginCenters */
+  
+  struct QuadVertex {
+    float center[3];
+    float corner[2];
+    float sprite[4];   /* adj, size */
+    u8    color[4];
+  };
+  std::vector<QuadVertex>   quads;    /* shader input, four per sprite */
+  bool                      quadsValid;
+  BufferObject              quadBuffer;
+  std::vector<unsigned int> pending;  /* quads to draw at drawEnd */
+  bool useMargin;
+  bool useShader;
+  int  spriteAttribute;
+  
   void getAdj(int index);
+  void updateMargin(RenderContext* renderContext);
+  Vertex getCenter(int index) { return useMargin ? marginCenters[index] : vertex.get(index); }
+  Vec3 getFixedScale(RenderContext* renderContext);
+  bool setSpriteMatrix(RenderContext* renderContext, int index, float* s);
+  bool hasNestedSprites();
+  void drawMerged(RenderContext* renderContext, PrimitiveSet* shape);
+  void buildQuads(RenderContext* renderContext);
+  bool beginShader(RenderContext* renderContext);
+  void endShader();
 };
 
 } // namespace rgl
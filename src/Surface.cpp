@@ -1,8 +1,20 @@
 #include "Surface.h"
 #include "Material.h"
+#include "subscene.h"
+#include "R.h"
+
+#include <cfloat>
 
 using namespace rgl;
 
+/* Surfaces with more cells than this are drawn in tiles whose
+   resolution depends on their size on screen; a cell of a tile is
+   kept at least SURFACE_LOD_PIXELS across where possible. */
+
+#define SURFACE_TILE      64
+#define SURFACE_LOD_CELLS (1024*1024)
+#define SURFACE_LOD_PIXELS 4.0f
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // CLASS
@@ -15,7 +27,9 @@ Surface::Surface(Material& in_material, int in_nx, int in_nz, double* in_x, doub
                  double* in_normal_x, double* in_normal_z, double* in_normal_y,
                  double* in_texture_s, double* in_texture_t,
 	         int* in_coords, int in_orientation, int* in_flags, int in_ignoreExtent)
-: Shape(in_material, in_ignoreExtent)
+: Shape(in_material, in_ignoreExtent),
+  indexBuffer(true),
+  lodBuffer(true)
 {
   nx = in_nx;
   nz = in_nz;
@@ -96,6 +110,244 @@ Surface::Surface(Material& in_material, int in_nx, int in_nz, double* in_x, doub
                                   || material.back  == material.POINT_FACE))
    || (material.line_antialias  && ( material.front == material.LINE_FACE 
                                   || material.back  == material.LINE_FACE))) blended = true;
+
+  initStrips();
+  initTiles();
+  vertexArray.useBufferObject(true);
+  normalArray.useBufferObject(true);
+  texCoordArray.useBufferObject(true);
+  material.colors.useBufferObject(true);
+  indexBuffer.setEnabled(true);
+  lodBuffer.setEnabled(true);
+}
+
+/* Join a strip to the end of indices by repeating the last index
+   there and the first of the strip; an extra repeat keeps each strip
+   starting at an even position so the winding is unchanged. */
+
+static void joinStrip(std::vector<unsigned int>& indices, unsigned int first)
+{
+  if (!indices.empty()) {
+    indices.push_back(indices.back());
+    if (indices.size() % 2 == 0)
+      indices.push_back(first);
+    indices.push_back(first);
+  }
+}
+
+/* Append the strips through the vertex pairs (upper[i], lower[i]),
+   broken at pairs with a missing vertex.  upper is the row drawn
+   first, i.e. iz + orientation.  If keepStrips, each run is also
+   recorded for drawing separately. */
+
+void Surface::addStrips(std::vector<unsigned int>& indices, std::vector<unsigned int>& upper,
+                        std::vector<unsigned int>& lower, bool keepStrips)
+{
+  int n = upper.size(), i = 0;
+  while (i < n) {
+    while (i < n && (vertexArray[upper[i]].missing() || vertexArray[lower[i]].missing()))
+      i++;
+    if (i == n)
+      break;
+    int start = i;
+    while (i < n && !vertexArray[upper[i]].missing() && !vertexArray[lower[i]].missing())
+      i++;
+    if (i - start < 2)
+      continue;
+    joinStrip(indices, upper[start]);
+    if (keepStrips) {
+      Strip strip;
+      strip.first = indices.size();
+      strip.count = 2*(i - start);
+      strips.push_back(strip);
+    }
+    for (int j = start; j < i; j++) {
+      indices.push_back(upper[j]);
+      indices.push_back(lower[j]);
+    }
+  }
+}
+
+/* Index the whole grid once, joined into one triangle strip by
+   degenerate triangles.  Primitive restart would need OpenGL 3.1. */
+
+void Surface::initStrips()
+{
+  stripIndices.clear();
+  strips.clear();
+  std::vector<unsigned int> upper(nx), lower(nx);
+  for (int iz = 0; iz < nz-1; iz++) {
+    for (int ix = 0; ix < nx; ix++) {
+      upper[ix] = (iz + orientation)*nx + ix;
+      lower[ix] = (iz + !orientation)*nx + ix;
+    }
+    addStrips(stripIndices, upper, lower, true);
+  }
+}
+
+/* Bounding boxes of SURFACE_TILE square blocks of cells, for grids
+   large enough to need them */
+
+void Surface::initTiles()
+{
+  tiles.clear();
+  if ((double)(nx-1)*(nz-1) <= SURFACE_LOD_CELLS)
+    return;
+  ntx = (nx - 2)/SURFACE_TILE + 1;
+  ntz = (nz - 2)/SURFACE_TILE + 1;
+  tiles.resize(ntx*ntz);
+  for (int tz = 0; tz < ntz; tz++)
+    for (int tx = 0; tx < ntx; tx++) {
+      Tile& tile = tiles[tz*ntx + tx];
+      tile.missing = false;
+      int ix1 = getMin((tx + 1)*SURFACE_TILE, nx - 1),
+          iz1 = getMin((tz + 1)*SURFACE_TILE, nz - 1);
+      for (int iz = tz*SURFACE_TILE; iz <= iz1; iz++)
+        for (int ix = tx*SURFACE_TILE; ix <= ix1; ix++) {
+          const Vertex& v = vertexArray[iz*nx + ix];
+          if (v.missing())
+            tile.missing = true;
+          else
+            tile.box += v;
+        }
+    }
+  steps.assign(tiles.size(), 0);
+}
+
+/* Choose the grid step of each tile from the size of its bounding
+   box on screen.  Tiles off screen get the coarsest step; tiles
+   crossing the eye plane or holding missing vertices are drawn in
+   full.  Returns whether any step changed. */
+
+bool Surface::chooseSteps(RenderContext* renderContext)
+{
+  Subscene* subscene = renderContext->subscene;
+  Matrix4x4 P(subscene->projMatrix), M(subscene->modelMatrix),
+            MVP = P*M;
+  float halfWidth  = subscene->pviewport.width/2.0f,
+        halfHeight = subscene->pviewport.height/2.0f;
+  bool changed = false;
+  for (size_t i = 0; i < tiles.size(); i++) {
+    const Tile& tile = tiles[i];
+    int step = 1;
+    if (!tile.missing && tile.box.isValid()) {
+      float xmin = FLT_MAX, xmax = -FLT_MAX, ymin = FLT_MAX, ymax = -FLT_MAX;
+      bool behind = false;
+      for (int j = 0; j < 8 && !behind; j++) {
+        Vec4 c = MVP*Vec4( (j & 1) ? tile.box.vmax.x : tile.box.vmin.x,
+                           (j & 2) ? tile.box.vmax.y : tile.box.vmin.y,
+                           (j & 4) ? tile.box.vmax.z : tile.box.vmin.z, 1.0f);
+        if (c.w <= 0.0f)
+          behind = true;
+        else {
+          xmin = getMin(xmin, c.x/c.w);
+          xmax = getMax(xmax, c.x/c.w);
+          ymin = getMin(ymin, c.y/c.w);
+          ymax = getMax(ymax, c.y/c.w);
+        }
+      }
+      if (!behind) {
+        if (xmax < -1.0f || xmin > 1.0f || ymax < -1.0f || ymin > 1.0f)
+          step = SURFACE_TILE;
+        else {
+          float pixels = getMax((xmax - xmin)*halfWidth, (ymax - ymin)*halfHeight);
+          while (step < SURFACE_TILE && pixels*step < SURFACE_TILE*SURFACE_LOD_PIXELS)
+            step *= 2;
+        }
+      }
+    }
+    if (steps[i] != step) {
+      steps[i] = step;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+int Surface::getStep(int tx, int tz)
+{
+  if (tx < 0 || tx >= ntx || tz < 0 || tz >= ntz)
+    return 1;
+  return steps[tz*ntx + tx];
+}
+
+/* Rows and columns of a tile at its step; the last is always the
+   tile edge */
+
+static void tileLines(std::vector<int>& lines, int first, int last, int step)
+{
+  lines.clear();
+  for (int i = first; i < last; i += step)
+    lines.push_back(i);
+  lines.push_back(last);
+}
+
+/* Move a vertex on a shared edge down to the coarser step of the
+   neighbour, so the edges of both tiles match.  This only collapses
+   triangles along the edge, so no cracks appear. */
+
+static inline int snapLine(int i, int first, int last, int step)
+{
+  if (i == last)
+    return i;
+  return first + ((i - first)/step)*step;
+}
+
+void Surface::addTile(int tx, int tz)
+{
+  int step = getStep(tx, tz),
+      ix0 = tx*SURFACE_TILE, ix1 = getMin(ix0 + SURFACE_TILE, nx - 1),
+      iz0 = tz*SURFACE_TILE, iz1 = getMin(iz0 + SURFACE_TILE, nz - 1),
+      left   = getMax(step, getStep(tx - 1, tz)),
+      right  = getMax(step, getStep(tx + 1, tz)),
+      top    = getMax(step, getStep(tx, tz - 1)),
+      bottom = getMax(step, getStep(tx, tz + 1));
+  std::vector<int> xs, zs;
+  tileLines(xs, ix0, ix1, step);
+  tileLines(zs, iz0, iz1, step);
+  int n = xs.size();
+  std::vector<unsigned int> upper(n), lower(n);
+  for (size_t k = 0; k + 1 < zs.size(); k++) {
+    for (int side = 0; side < 2; side++) {
+      int iz = zs[k + (side != orientation)];
+      std::vector<unsigned int>& row = side ? lower : upper;
+      for (int j = 0; j < n; j++) {
+        int ix = xs[j], z = iz;
+        if (iz == iz0)
+          ix = snapLine(ix, ix0, ix1, top);
+        else if (iz == iz1)
+          ix = snapLine(ix, ix0, ix1, bottom);
+        if (ix == ix0)
+          z = snapLine(z, iz0, iz1, left);
+        else if (ix == ix1)
+          z = snapLine(z, iz0, iz1, right);
+        row[j] = z*nx + ix;
+      }
+    }
+    addStrips(lodIndices, upper, lower, false);
+  }
+}
+
+void Surface::buildLOD()
+{
+  lodIndices.clear();
+  for (int tz = 0; tz < ntz; tz++)
+    for (int tx = 0; tx < ntx; tx++)
+      addTile(tx, tz);
+  lodBuffer.invalidate();
+}
+
+void Surface::drawStrip(std::vector<unsigned int>& indices, BufferObject& buffer)
+{
+#ifndef RGL_NO_OPENGL
+  if (indices.empty())
+    return;
+  bool buffered = buffer.bind(&indices[0], indices.size()*sizeof(unsigned int));
+  glDrawElements(GL_TRIANGLE_STRIP, indices.size(), GL_UNSIGNED_INT, 
+                 buffered ? 0 : &indices[0]);
+  if (buffered)
+    buffer.unbind();
+#endif
 }
 
 Vertex Surface::getNormal(int ix, int iz)
@@ -135,39 +387,33 @@ Vertex Surface::getNormal(int ix, int iz)
   return total;
 }
 
-void Surface::draw(RenderContext* renderContext)
+/* Filled smooth surfaces are drawn as one triangle strip, from
+   tiles of varying resolution if the grid is large.  Outlines and
+   flat shading would show the diagonals, so those draw a quad strip
+   per run of the full grid. */
+
+void Surface::drawAll(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL
-  bool missing;
-  drawBegin(renderContext);
-
-  for(int iz=0;iz<nz-1;iz++) {
-
-    missing = true;
-    
-    for(int ix=0;ix<nx;ix++) {
-
-      int i;
-      
-      if ( missing != (vertexArray[iz*nx+ix].missing() || vertexArray[(iz+1)*nx+ix].missing()) ) {
-        missing = !missing;
-        if (missing) glEnd();
-        else glBegin(GL_QUAD_STRIP);
-      }
-      if (!missing) {
-        // If orientation == 1, we draw iz+1 first, otherwise iz first      
-        i = (iz+  orientation)*nx+ix;
-  
-        glArrayElement( i );
-  
-        i = (iz+ !orientation)*nx+ix;
-        glArrayElement( i );
-      }
-    }
-    if (!missing) glEnd();
+  if (strips.empty())
+    return;
+  if (material.smooth && material.front != material.LINE_FACE 
+                      && material.back  != material.LINE_FACE) {
+    if (useLOD()) {
+      if (chooseSteps(renderContext))
+        buildLOD();
+      drawStrip(lodIndices, lodBuffer);
+    } else
+      drawStrip(stripIndices, indexBuffer);
+  } else {
+    bool buffered = indexBuffer.bind(&stripIndices[0], stripIndices.size()*sizeof(unsigned int));
+    const unsigned int* base = buffered ? 0 : &stripIndices[0];
+    for (size_t i = 0; i < strips.size(); i++)
+      glDrawElements(GL_QUAD_STRIP, strips[i].count, GL_UNSIGNED_INT, base + strips[i].first);
+    if (buffered)
+      indexBuffer.unbind();
   }
-
-  drawEnd(renderContext);
+  SAVEGLERROR;
 #endif
 }
 
@@ -4,8 +4,10 @@
 #include "Shape.h"
 
 #include "render.h"
+#include "BufferObject.h"
 
 #include <map>
+#include <vector>
 
 namespace rgl {
 
@@ -23,7 +25,13 @@ public:
   /**
    * overload
    **/
-  virtual void draw(RenderContext* renderContext);
+  virtual void drawAll(RenderContext* renderContext);
+  
+  /**
+   * the level of detail depends on the view, so it can't go in a
+   * display list
+   **/
+  virtual bool hasBufferObjects() { return BufferObject::isSupported() || useLOD(); }
   
   /* Center of square with upper left at (ix, iz) */
   Vertex getCenter(int ix, int iz);  
@@ -57,12 +65,41 @@ public:
   
 private:
   Vertex getNormal(int ix, int iz);
+  void initStrips();
+  void addStrips(std::vector<unsigned int>& indices, std::vector<unsigned int>& upper,
+                 std::vector<unsigned int>& lower, bool keepStrips);
+  void drawStrip(std::vector<unsigned int>& indices, BufferObject& buffer);
+
+  /* a run of cells without missing vertices */
+  struct Strip {
+    int first, count;
+  };
+
+  /* level of detail for large grids */
+  struct Tile {
+    AABox box;
+    bool missing;
+  };
+  bool useLOD() { return !tiles.empty(); }
+  void initTiles();
+  bool chooseSteps(RenderContext* renderContext);
+  void buildLOD();
+  void addTile(int tx, int tz);
+  int  getStep(int tx, int tz);
 
   VertexArray vertexArray;
   NormalArray normalArray;
   TexCoordArray texCoordArray;
   int nx, nz, coords[3], orientation, user_normals, user_textures;
   bool use_normal, use_texcoord; 
+  std::vector<unsigned int> stripIndices;  /* all strips, joined by degenerate triangles */
+  std::vector<Strip> strips;
+  BufferObject indexBuffer;
+  int ntx, ntz;
+  std::vector<Tile> tiles;
+  std::vector<int> steps;                /* grid step of each tile */
+  std::vector<unsigned int> lodIndices;  /* the strip for the current steps */
+  BufferObject lodBuffer;
 };
 
 } // namespace rgl
@@ -4,8 +4,14 @@
 #include "R.h"
 #include "BBoxDeco.h"
 #include "subscene.h"
+#include "OITBuffer.h"
+#include "gl2ps.h"
+#include <cmath>
+#include <cstddef>
 #ifdef HAVE_FREETYPE
 #include <map>
+#include "GlyphAtlas.h"
+#include "FTUnicode.h"
 #endif
 
 using namespace rgl;
@@ -26,7 +32,8 @@ TextSet::TextSet(Material& in_material, int in_ntexts, char** in_texts, double *
                  int in_npos,
                  const int* in_pos)
  : Shape(in_material, in_ignoreExtent),
-   npos(in_npos)
+   npos(in_npos), glyphsValid(false), glyphBuffer(false), useGlyphs(false),
+   boundAtlas(NULL)
 {
   int i;
 
@@ -67,6 +74,7 @@ TextSet::TextSet(Material& in_material, int in_ntexts, char** in_texts, double *
   for (i=0; i<npos; i++)
     pos[i] = in_pos[i];
 
+  glyphBuffer.setEnabled(true);
 }
 
 TextSet::~TextSet()
@@ -83,11 +91,21 @@ void TextSet::drawBegin(RenderContext* renderContext)
 {
   Shape::drawBegin(renderContext);
   material.beginUse(renderContext);
+  useGlyphs = beginGlyphs(renderContext);
 }
 
 void TextSet::drawPrimitive(RenderContext* renderContext, int index) 
 {
 #ifndef RGL_NO_OPENGL
+  if (useGlyphs) {
+    int first = labelFirst[index], count = labelFirst[index + 1] - first;
+    if (count) {
+      useAtlas(renderContext, fonts[index % fonts.size()]->getAtlas());
+      glDrawArrays(GL_QUADS, first, count);
+    }
+    return;
+  }
+  
   BBoxDeco* bboxdeco = 0;
   if (material.marginCoord >= 0) {
     Subscene* subscene = renderContext->subscene;
@@ -115,14 +133,268 @@ void TextSet::drawPrimitive(RenderContext* renderContext, int index)
 #endif
 }
 
+/* Consecutive labels in the same font are drawn with one call */
+
+void TextSet::drawAll(RenderContext* renderContext)
+{
+#ifndef RGL_NO_OPENGL
+  if (!useGlyphs) {
+    Shape::drawAll(renderContext);
+    return;
+  }
+  int n = textArray.size(), i = 0;
+  while (i < n) {
+    GlyphAtlas* atlas = fonts[i % fonts.size()]->getAtlas();
+    int j = i + 1;
+    while (j < n && fonts[j % fonts.size()]->getAtlas() == atlas)
+      j++;
+    if (labelFirst[j] > labelFirst[i]) {
+      useAtlas(renderContext, atlas);
+      glDrawArrays(GL_QUADS, labelFirst[i], labelFirst[j] - labelFirst[i]);
+    }
+    i = j;
+  }
+  SAVEGLERROR;
+#endif
+}
+
 void TextSet::drawEnd(RenderContext* renderContext)
 {
 #ifndef RGL_NO_OPENGL
+  if (useGlyphs) {
+    endGlyphs();
+    useGlyphs = false;
+  }
   material.endUse(renderContext);
   Shape::drawEnd(renderContext);
 #endif
 }
 
+const char* TextSet::glyphVertexShader =
+"#version 120\n"
+"uniform vec2 viewport;\n"
+"uniform vec2 atlasSize;\n"
+"void main() {\n"
+"  vec4 eye = gl_ModelViewMatrix*gl_Vertex;\n"
+"  vec4 clip = gl_ProjectionMatrix*eye;\n"
+"  vec3 offset = gl_MultiTexCoord1.xyz;\n"
+"  // the anchor goes on a pixel corner, so labels keep their shape as the view moves\n"
+"  vec2 win = floor((0.5*clip.xy/clip.w + 0.5)*viewport + 0.5) + offset.xy;\n"
+"  gl_Position = vec4((2.0*win/viewport - 1.0)*clip.w, clip.z + 2.0*offset.z*clip.w, clip.w);\n"
+"  // clip planes see only the anchor, like a raster position\n"
+"  gl_ClipVertex = eye;\n"
+"  gl_FrontColor = gl_Color;\n"
+"  gl_BackColor = gl_Color;\n"
+"  gl_TexCoord[0] = vec4(gl_MultiTexCoord0.xy/atlasSize, 0.0, 1.0);\n"
+"  gl_FogFragCoord = abs(eye.z);\n"
+"}\n";
+
+/* The outline is at 0.5 in the distance field; the smoothing width
+   follows the screen size of a texel, so edges stay one pixel wide at
+   any scale.  Fog is applied here as the fixed function would. */
+
+const char* TextSet::glyphFragmentShader =
+"#version 120\n"
+"uniform sampler2D atlas;\n"
+"uniform int fogMode;   // 0 = none, 1 = linear, 2 = exp, 3 = exp2\n"
+"void main() {\n"
+"  float d = texture2D(atlas, gl_TexCoord[0].st).a;\n"
+"  float w = max(0.5*fwidth(d), 1e-4);\n"
+"  vec4 color = vec4(gl_Color.rgb, gl_Color.a*smoothstep(0.5 - w, 0.5 + w, d));\n"
+"  if (fogMode != 0) {\n"
+"    float f;\n"
+"    if (fogMode == 1)\n"
+"      f = (gl_Fog.end - gl_FogFragCoord)*gl_Fog.scale;\n"
+"    else if (fogMode == 2)\n"
+"      f = exp(-gl_Fog.density*gl_FogFragCoord);\n"
+"    else\n"
+"      f = exp(-pow(gl_Fog.density*gl_FogFragCoord, 2.0));\n"
+"    color.rgb = mix(gl_Fog.color.rgb, color.rgb, clamp(f, 0.0, 1.0));\n"
+"  }\n"
+"  gl_FragColor = color;\n"
+"}\n";
+
+/* With FreeType fonts, labels are drawn as quads textured from each
+   font's GlyphAtlas instead of with a raster position and a pixmap per
+   label; the depth test takes the place of the raster position query.
+   The quads need GLSL, and gl2ps and the OIT pass draw text their own
+   way, so then the raster path is used. */
+
+bool TextSet::beginGlyphs(RenderContext* renderContext)
+{
+#if defined(HAVE_FREETYPE) && !defined(RGL_NO_OPENGL)
+  ShaderProgram* program = renderContext->glyphProgram;
+  if (!program || !textArray.size() || material.texture
+      || renderContext->gl2psActive != GL2PS_NONE
+      || (renderContext->oit && renderContext->oit->isActive()))
+    return false;
+  for (size_t i = 0; i < fonts.size(); i++)
+    if (!fonts[i]->getAtlas())
+      return false;
+  if (!program->use())
+    return false;
+  
+  BBoxDeco* bboxdeco = 0;
+  if (material.marginCoord >= 0)
+    bboxdeco = renderContext->subscene->get_bboxdeco();
+  if (bboxdeco) {
+    MarginTransform current = bboxdeco->getMarginTransform(renderContext, &material);
+    if (current != glyphMargin) {
+      glyphMargin = current;
+      glyphsValid = false;
+    }
+  }
+  if (!glyphsValid)
+    buildGlyphs(renderContext, bboxdeco);
+  
+  const Rect2& viewport = renderContext->subscene->pviewport;
+  glUniform2f(program->getUniform("viewport"), (float)viewport.width, (float)viewport.height);
+  int fogMode = 0;
+  if (glIsEnabled(GL_FOG)) {
+    GLint mode;
+    glGetIntegerv(GL_FOG_MODE, &mode);
+    fogMode = mode == GL_LINEAR ? 1 : mode == GL_EXP ? 2 : 3;
+  }
+  glUniform1i(program->getUniform("fogMode"), fogMode);
+  
+  /* glyph distance fields are in the alpha channel */
+  glPushAttrib(GL_COLOR_BUFFER_BIT | GL_ENABLE_BIT | GL_TEXTURE_BIT);
+  glEnable(GL_BLEND);
+  if (!material.isTransparent())
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glEnable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GREATER, 0.0f);
+  glEnable(GL_TEXTURE_2D);
+  glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+  boundAtlas = NULL;
+  
+  const char* base = glyphQuads.size() ? (const char*) &glyphQuads[0] : NULL;
+  GLsizei stride = sizeof(GlyphVertex);
+  bool buffered = base && glyphBuffer.bind(base, glyphQuads.size()*sizeof(GlyphVertex));
+  if (buffered)
+    base = 0;
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, base + offsetof(GlyphVertex, anchor));
+  glEnableClientState(GL_COLOR_ARRAY);
+  glColorPointer(4, GL_UNSIGNED_BYTE, stride, base + offsetof(GlyphVertex, color));
+  glClientActiveTexture(GL_TEXTURE1);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glTexCoordPointer(3, GL_FLOAT, stride, base + offsetof(GlyphVertex, offset));
+  glClientActiveTexture(GL_TEXTURE0);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glTexCoordPointer(2, GL_FLOAT, stride, base + offsetof(GlyphVertex, texel));
+  if (buffered)
+    glyphBuffer.unbind();
+  SAVEGLERROR;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/* Lay out every label once:  the offsets from the anchor depend only
+   on the font, adj and pos, not on the view. */
+
+void TextSet::buildGlyphs(RenderContext* renderContext, BBoxDeco* bboxdeco)
+{
+#ifdef HAVE_FREETYPE
+  int n = textArray.size(), ncolor = material.colors.getLength();
+  glyphQuads.clear();
+  labelFirst.resize(n + 1);
+  for (int index = 0; index < n; index++) {
+    labelFirst[index] = glyphQuads.size();
+    Vertex pt = vertexArray[index];
+    if (bboxdeco)
+      pt = glyphMargin.apply(pt);
+    if (pt.missing())
+      continue;
+    GLFont* font = fonts[index % fonts.size()];
+    GlyphAtlas* atlas = font->getAtlas();
+    const unsigned char* text = (const unsigned char*) textArray[index].c_str();
+    
+    /* as FTFont::Advance, but unhinted */
+    float scale = (float)font->getAtlasScale();
+    double twidth = 0.0;
+    for (FTUnicodeStringItr<unsigned char> c(text); *c; ) {
+      unsigned int code = *c++;
+      const GlyphAtlas::Glyph* glyph = atlas->getGlyph(code);
+      if (glyph)
+        twidth += scale*glyph->advance;
+      if (*c)
+        twidth += scale*atlas->getKerning(code, *c);
+    }
+    double theight = font->height(), 
+           ax = adjx, ay = adjy, az = adjz;
+    font->adjustForPos(twidth, pos[index % npos], &ax, &ay, &az);
+    float dx = (float)(-twidth*ax), 
+          dy = floorf((float)(-theight*ay) + 0.5f), 
+          dz = (float)(-theight*(az - 0.5)/1000.0);
+    
+    GlyphVertex v;
+    v.anchor[0] = pt.x;
+    v.anchor[1] = pt.y;
+    v.anchor[2] = pt.z;
+    v.offset[2] = dz;
+    if (ncolor)
+      memcpy(v.color, material.colors.getColorPtr(index % ncolor), 4);
+    else
+      memset(v.color, 255, 4);
+    
+    float pen = 0.0f;
+    for (FTUnicodeStringItr<unsigned char> c(text); *c; ) {
+      unsigned int code = *c++;
+      const GlyphAtlas::Glyph* glyph = atlas->getGlyph(code);
+      if (glyph && glyph->width && glyph->height) {
+        float x0 = dx + scale*(pen + glyph->left), x1 = x0 + scale*glyph->width,
+              y1 = dy + scale*glyph->top, y0 = y1 - scale*glyph->height,
+              s0 = glyph->x, s1 = s0 + glyph->width,
+              t0 = glyph->y + glyph->height, t1 = glyph->y;
+        float corners[4][4] = { {x0, y0, s0, t0}, {x1, y0, s1, t0}, 
+                                {x1, y1, s1, t1}, {x0, y1, s0, t1} };
+        for (int k = 0; k < 4; k++) {
+          v.offset[0] = corners[k][0];
+          v.offset[1] = corners[k][1];
+          v.texel[0] = corners[k][2];
+          v.texel[1] = corners[k][3];
+          glyphQuads.push_back(v);
+        }
+      }
+      if (glyph)
+        pen += glyph->advance;
+      if (*c)
+        pen += atlas->getKerning(code, *c);
+    }
+  }
+  labelFirst[n] = glyphQuads.size();
+  glyphBuffer.invalidate();
+  glyphsValid = true;
+#endif
+}
+
+void TextSet::useAtlas(RenderContext* renderContext, GlyphAtlas* atlas)
+{
+#if defined(HAVE_FREETYPE) && !defined(RGL_NO_OPENGL)
+  if (atlas != boundAtlas) {
+    atlas->bind();
+    glUniform2f(renderContext->glyphProgram->getUniform("atlasSize"), 
+                (float)atlas->getWidth(), (float)atlas->getHeight());
+    boundAtlas = atlas;
+  }
+#endif
+}
+
+void TextSet::endGlyphs()
+{
+#ifndef RGL_NO_OPENGL
+  glPopClientAttrib();
+  glPopAttrib();
+  ShaderProgram::useNone();
+  boundAtlas = NULL;
+  SAVEGLERROR;
+#endif
+}
+
 int TextSet::getAttributeCount(SceneNode* subscene, AttribID attrib) 
 {
   switch (attrib) {
@@ -8,6 +8,8 @@
 
 #include "render.h"
 #include "glgui.h"
+#include "BBoxDeco.h"
+#include "BufferObject.h"
 #ifdef HAVE_FREETYPE
 #include "FTGL/ftgl.h"
 #endif
@@ -27,7 +29,10 @@ public:
   ~TextSet();
   /* Can't use display lists */
   void render(RenderContext* renderContext);
+  virtual bool isDrawnDirectly() { return true; }
   virtual std::string getTypeName() { return "text"; };
+  /* text extends beyond its anchor */
+  virtual bool isCullable() { return false; }
 
   int getElementCount(void){ return textArray.size(); }
   int getAttributeCount(SceneNode* subscene, AttribID attrib);
@@ -38,8 +43,16 @@ public:
 
   void drawBegin(RenderContext* renderContext);
   void drawPrimitive(RenderContext* renderContext, int index);
+  void drawAll(RenderContext* renderContext);
   void drawEnd(RenderContext* renderContext);
 
+  /**
+   * shaders placing glyph quads and thresholding their distance fields,
+   * see RenderContext::glyphProgram
+   **/
+  static const char* glyphVertexShader;
+  static const char* glyphFragmentShader;
+
 private:
 
   VertexArray vertexArray;
@@ -52,6 +65,28 @@ private:
   
   int npos;
   int* pos;
+  
+  /* With FreeType fonts the labels are laid out once as textured
+     quads around their anchors, scaled from the font's atlas to its
+     size; the shader places them in the window. */
+  struct GlyphVertex {
+    float anchor[3];
+    float offset[3];	/* pixels from the anchor, and window depth */
+    float texel[2];	/* in the font's GlyphAtlas */
+    u8    color[4];
+  };
+  std::vector<GlyphVertex> glyphQuads;
+  std::vector<int> labelFirst;	/* first vertex of each label, then the end */
+  bool glyphsValid;
+  BufferObject glyphBuffer;
+  MarginTransform glyphMargin;	/* the transform used for the anchors */
+  bool useGlyphs;	/* set between drawBegin and drawEnd */
+  GlyphAtlas* boundAtlas;
+  
+  bool beginGlyphs(RenderContext* renderContext);
+  void buildGlyphs(RenderContext* renderContext, BBoxDeco* bboxdeco);
+  void useAtlas(RenderContext* renderContext, GlyphAtlas* atlas);
+  void endGlyphs();
 };
 
 } // namespace rgl
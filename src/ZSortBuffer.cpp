@@ -0,0 +1,246 @@
+#include "ZSortBuffer.h"
+#include "R.h"
+
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace rgl;
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// CLASS
+//   ZSortBuffer
+//
+
+// radix sort digits
+#define RADIX_BITS 11
+#define RADIX_SIZE (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX_SIZE - 1)
+
+// map a float to an unsigned int with the same ordering
+
+static inline unsigned int floatKey(float f)
+{
+  unsigned int u;
+  memcpy(&u, &f, sizeof(u));
+  return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// below this many primitives threads cost more than they save
+
+#define PARALLEL_MIN 20000
+
+static inline int sortThreads(size_t n)
+{
+#ifdef _OPENMP
+  if (n >= PARALLEL_MIN)
+    return omp_get_max_threads();
+#endif
+  return 1;
+}
+
+// insertion sort repair gives up after this many moves per primitive
+
+#define REPAIR_BUDGET 4
+
+static inline bool sameRow(const Vec4& a, const Vec4& b)
+{
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+ZSortBuffer::ZSortBuffer()
+: valid(false), sorted(false)
+{
+}
+
+void ZSortBuffer::sort(const std::vector<Shape*>& shapes, const Vec4& Zrow, const Vec4& Wrow)
+{
+  bool changed;
+  if (!valid || !matches(shapes)) {
+    collect(shapes);
+    sorted = false;
+    changed = true;
+  } else
+    changed = refresh();
+
+  if (sorted && !changed && sameRow(Zrow, lastZrow) && sameRow(Wrow, lastWrow))
+    return;
+
+  computeKeys(Zrow, Wrow);
+  if (!sorted || !insertionSort())
+    radixSort();
+  lastZrow = Zrow;
+  lastWrow = Wrow;
+  sorted = true;
+}
+
+void ZSortBuffer::collect(const std::vector<Shape*>& shapes)
+{
+  ranges.clear();
+  items.clear();
+  centers.clear();
+  std::vector<Shape*>::const_iterator iter;
+  for (iter = shapes.begin(); iter != shapes.end(); ++iter) {
+    Shape* shape = *iter;
+    Range range;
+    range.shape = shape;
+    range.first = items.size();
+    range.count = shape->getPrimitiveCount();
+    range.moving = shape->getCentersChange();
+    ranges.push_back(range);
+    for (int j = 0; j < range.count; j++) {
+      items.push_back(ShapeItem(shape, j));
+      centers.push_back(shape->getPrimitiveCenter(j));
+    }
+  }
+  valid = true;
+}
+
+bool ZSortBuffer::matches(const std::vector<Shape*>& shapes)
+{
+  if (ranges.size() != shapes.size())
+    return false;
+  for (size_t i = 0; i < ranges.size(); i++)
+    if (ranges[i].shape != shapes[i]
+     || ranges[i].count != shapes[i]->getPrimitiveCount())
+      return false;
+  return true;
+}
+
+/* missing centers are NaN, which compares unequal to itself */
+
+static inline bool sameValue(float a, float b)
+{
+  return a == b || (ISNAN(a) && ISNAN(b));
+}
+
+bool ZSortBuffer::refresh()
+{
+  bool changed = false;
+  std::vector<Range>::const_iterator iter;
+  for (iter = ranges.begin(); iter != ranges.end(); ++iter)
+    if (iter->moving)
+      for (int j = 0; j < iter->count; j++) {
+        Vertex center = iter->shape->getPrimitiveCenter(j);
+        Vertex& old = centers[iter->first + j];
+        if (!sameValue(center.x, old.x) || !sameValue(center.y, old.y)
+         || !sameValue(center.z, old.z)) {
+          old = center;
+          changed = true;
+        }
+      }
+  return changed;
+}
+
+void ZSortBuffer::computeKeys(const Vec4& Zrow, const Vec4& Wrow)
+{
+  long n = (long)centers.size();
+  keys.resize(n);
+#ifdef _OPENMP
+#pragma omp parallel for num_threads(sortThreads(n)) schedule(static)
+#endif
+  for (long i = 0; i < n; i++) {
+    const Vertex& v = centers[i];
+    float z = Zrow.x*v.x + Zrow.y*v.y + Zrow.z*v.z + Zrow.w,
+          w = Wrow.x*v.x + Wrow.y*v.y + Wrow.z*v.z + Wrow.w;
+    /* furthest first */
+    keys[i] = floatKey(-z/w);
+  }
+}
+
+/* Insertion sort of the previous order by the new keys.  After a
+   small change of view few primitives move far, so this is close to
+   linear; it stops once the moves exceed the budget, leaving order
+   permuted but complete. */
+
+bool ZSortBuffer::insertionSort()
+{
+  size_t n = order.size();
+  size_t budget = REPAIR_BUDGET*n;
+  for (size_t i = 1; i < n; i++) {
+    unsigned int item = order[i], key = keys[item];
+    size_t j = i;
+    while (j > 0 && keys[order[j-1]] > key) {
+      order[j] = order[j-1];
+      j--;
+    }
+    order[j] = item;
+    if (i - j > budget)
+      return false;
+    budget -= i - j;
+  }
+  return true;
+}
+
+/* Stable LSD radix sort of order by keys.  Passes where all keys
+   share the same digit are skipped.  With OpenMP each thread counts
+   and scatters a contiguous block, so the result doesn't depend on
+   the number of threads. */
+
+void ZSortBuffer::radixSort()
+{
+  size_t n = keys.size();
+  order.resize(n);
+  for (size_t i = 0; i < n; i++)
+    order[i] = (unsigned int)i;
+  if (n < 2)
+    return;
+  sortKeys = keys;
+  keysScratch.resize(n);
+  orderScratch.resize(n);
+
+  int nthreads = sortThreads(n);
+  counts.resize(nthreads*RADIX_SIZE);
+  for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+    bool skip = false;
+#ifdef _OPENMP
+#pragma omp parallel num_threads(nthreads)
+#endif
+    {
+#ifdef _OPENMP
+      int t = omp_get_thread_num(), nt = omp_get_num_threads();
+#else
+      int t = 0, nt = 1;
+#endif
+      size_t* count = &counts[t*RADIX_SIZE];
+      size_t lo = n*t/nt, hi = n*(t + 1)/nt;
+      memset(count, 0, RADIX_SIZE*sizeof(size_t));
+      for (size_t i = lo; i < hi; i++)
+        count[(sortKeys[i] >> shift) & RADIX_MASK]++;
+#ifdef _OPENMP
+#pragma omp barrier
+#pragma omp single
+#endif
+      {
+        /* turn the counts into the first destination of each
+           thread's block of each digit */
+        size_t first = 0, d0 = (sortKeys[0] >> shift) & RADIX_MASK;
+        for (int u = 0; u < nt; u++)
+          first += counts[u*RADIX_SIZE + d0];
+        if (first == n)
+          skip = true;
+        else {
+          size_t sum = 0;
+          for (int d = 0; d < RADIX_SIZE; d++)
+            for (int u = 0; u < nt; u++) {
+              size_t c = counts[u*RADIX_SIZE + d];
+              counts[u*RADIX_SIZE + d] = sum;
+              sum += c;
+            }
+        }
+      }
+      if (!skip)
+        for (size_t i = lo; i < hi; i++) {
+          size_t dest = count[(sortKeys[i] >> shift) & RADIX_MASK]++;
+          keysScratch[dest] = sortKeys[i];
+          orderScratch[dest] = order[i];
+        }
+    }
+    if (!skip) {
+      sortKeys.swap(keysScratch);
+      order.swap(orderScratch);
+    }
+  }
+}
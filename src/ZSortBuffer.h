@@ -0,0 +1,93 @@
+#ifndef RGL_ZSORT_BUFFER_H
+#define RGL_ZSORT_BUFFER_H
+
+#include <vector>
+
+#include "Shape.h"
+
+namespace rgl {
+
+//
+// CLASS
+//   ZSortBuffer
+//
+// Orders the primitives of blended shapes from back to front.  All storage
+// is kept between frames, so after the first frame sorting does not
+// allocate.  Primitive centers are cached until the shape list changes;
+// only shapes whose centers move (see Shape::getCentersChange) are
+// queried again on each frame.
+//
+// The order is also kept between frames, keyed on the rows of the
+// projection.  If neither the view nor any center changed (e.g. on an
+// expose event) it is reused as is; after a small rotation it is
+// repaired by insertion sort, and only sorted from scratch when that
+// needs too many moves.
+//
+
+class ZSortBuffer
+{
+public:
+  ZSortBuffer();
+
+  /**
+   * forget the cached primitives, e.g. because a shape was added or removed
+   **/
+  void invalidate() { valid = false; sorted = false; }
+
+  /**
+   * sort the primitives of the shapes by decreasing distance,
+   * given the rows of the projection that compute z and w
+   **/
+  void sort(const std::vector<Shape*>& shapes, const Vec4& Zrow, const Vec4& Wrow);
+
+  /**
+   * number of primitives in the last sort
+   **/
+  size_t size() const { return order.size(); }
+
+  /**
+   * i-th primitive in drawing order
+   **/
+  const ShapeItem& operator[](size_t i) const { return items[order[i]]; }
+
+private:
+  /**
+   * cache centers of all primitives
+   **/
+  void collect(const std::vector<Shape*>& shapes);
+  /**
+   * check that the cache still matches the shape list
+   **/
+  bool matches(const std::vector<Shape*>& shapes);
+  /**
+   * refresh centers of shapes that move
+   **/
+  bool refresh();
+  void computeKeys(const Vec4& Zrow, const Vec4& Wrow);
+  /**
+   * try to repair the previous order; returns false if it is too far off
+   **/
+  bool insertionSort();
+  void radixSort();
+
+  struct Range {
+    Shape* shape;
+    size_t first;
+    int count;
+    bool moving;
+  };
+
+  bool valid, sorted;
+  Vec4 lastZrow, lastWrow;
+  std::vector<Range>        ranges;
+  std::vector<ShapeItem>    items;
+  std::vector<Vertex>       centers;
+  std::vector<unsigned int> keys;   /* indexed by item */
+  std::vector<unsigned int> sortKeys, keysScratch;
+  std::vector<unsigned int> order, orderScratch;
+  std::vector<size_t>       counts;   /* radix histograms, one per thread */
+};
+
+} // namespace rgl
+
+#endif // RGL_ZSORT_BUFFER_H
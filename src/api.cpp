@@ -222,7 +222,8 @@ void rgl::rgl_clear(int* successptr, int *idata)
 // PARAMETERS
 //   idata
 //     [0]  stack TypeID
-//     [1]  id SceneNode identifier
+//     [1]  n, the number of ids; on return, the number removed
+//     [2]  n SceneNode identifiers, 0 for the last added of the type
 //
 //
 
@@ -235,9 +236,10 @@ void rgl::rgl_pop(int* successptr, int* idata)
   if (deviceManager && (device = deviceManager->getCurrentDevice())) {
 
     TypeID stackTypeID = (TypeID) idata[0];
-    int id = idata[1];
+    int n = idata[1];
  
-    success = as_success( device->pop( stackTypeID, id ) );
+    idata[1] = device->pop( stackTypeID, idata + 2, n );
+    success = as_success( idata[1] == n );
     CHECKGLERROR;
 
   }
@@ -318,6 +320,7 @@ void rgl::rgl_attrib_count(int* id, int* attrib, int* count)
 {
   Device* device;
   if (deviceManager && (device = deviceManager->getCurrentDevice())) {
+    device->flush();  // some attributes are computed when drawn
     RGLView* rglview = device->getRGLView();
     Scene* scene = rglview->getScene();
     Subscene* subscene = scene->whichSubscene(*id);
@@ -340,6 +343,7 @@ void rgl::rgl_attrib(int* id, int* attrib, int* first, int* count, double* resul
 {
   Device* device;
   if (deviceManager && (device = deviceManager->getCurrentDevice())) {
+    device->flush();  // some attributes are computed when drawn
     RGLView* rglview = device->getRGLView();
     Scene* scene = rglview->getScene();
     Subscene* subscene = scene->whichSubscene(*id);
@@ -358,6 +362,7 @@ void rgl::rgl_text_attrib(int* id, int* attrib, int* first, int* count, char** r
 {
   Device* device;
   if (deviceManager && (device = deviceManager->getCurrentDevice())) {
+    device->flush();  // some attributes are computed when drawn
     RGLView* rglview = device->getRGLView();
     Scene* scene = rglview->getScene();
     Subscene* subscene = scene->whichSubscene(*id);
@@ -622,10 +627,11 @@ void rgl::rgl_spheres(int* successptr, int* idata, double* vertex, double* radiu
 
     int nvertex = idata[0];
     int nradius = idata[1];
+    bool impostors = idata[2] != 0;
 
     success = as_success( device->add( new SphereSet(currentMaterial, nvertex, vertex, nradius, radius,
     						     device->getIgnoreExtent() || currentMaterial.marginCoord >= 0,
-    						     *fastTransparency != 0) ) );
+    						     *fastTransparency != 0, impostors) ) );
     CHECKGLERROR;
   }
 
@@ -969,12 +975,12 @@ void rgl::rgl_gc(int* count, int* protect)
               }
             }
           }
-          for (int j = 0; j < n; j++) {
-            if (ids[j] != 0) {
-              scene->pop(i, ids[j]);
-              (*count)++;
-            }
-          }
+          std::vector<int> unused;
+          for (int j = 0; j < n; j++)
+            if (ids[j] != 0)
+              unused.push_back(ids[j]);
+          if (unused.size())
+            *count += scene->pop(i, &unused[0], unused.size());
         }
       }
     }
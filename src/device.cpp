@@ -48,7 +48,14 @@ void Device::setName(const char* string)
 // ---------------------------------------------------------------------------
 void Device::update()
 {
-//  window->update();
+  if (window)
+    window->update();
+}
+// ---------------------------------------------------------------------------
+void Device::flush()
+{
+  if (window)
+    window->flush();
 }
 // ---------------------------------------------------------------------------
 bool Device::open(void)
@@ -106,7 +113,7 @@ bool Device::clear(TypeID stackTypeID)
 {
   bool success;
   success = scene->clear(stackTypeID);
-  rglview->update();
+  update();
   return success;
 }
 // ---------------------------------------------------------------------------
@@ -114,22 +121,22 @@ int Device::add(SceneNode* node)
 {
   bool success;
   success = scene->add(node);
-  rglview->update();
+  update();
   if (success) return node->getObjID();
   else return 0;
 }
 // ---------------------------------------------------------------------------
 
-bool Device::pop(TypeID stackTypeID, int id)
+int Device::pop(TypeID stackTypeID, const int* ids, int n)
 {
-  bool success;
+  int count;
   bool inGL = rglview->windowImpl->beginGL(); // May need to set context for display lists.
-  success = scene->pop(stackTypeID, id);
+  count = scene->pop(stackTypeID, ids, n);
   if (inGL) {
     rglview->windowImpl->endGL();
   }
-  rglview->update();
-  return success;
+  update();
+  return count;
 }
 // ---------------------------------------------------------------------------
 bool Device::snapshot(int format, const char* filename)
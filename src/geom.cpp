@@ -70,6 +70,31 @@ bool AABox::operator < (const AABox& that) const
   return true;
 }
 
+bool AABox::operator == (const AABox& that) const
+{
+  return vmin.x == that.vmin.x && vmin.y == that.vmin.y && vmin.z == that.vmin.z
+      && vmax.x == that.vmax.x && vmax.y == that.vmax.y && vmax.z == that.vmax.z;
+}
+
+bool AABox::isOutside(const Matrix4x4& M) const
+{
+  int outside = 0x3f;
+  for (int j = 0; j < 8 && outside; j++) {
+    Vec4 c = M*Vec4( (j & 1) ? vmax.x : vmin.x,
+                     (j & 2) ? vmax.y : vmin.y,
+                     (j & 4) ? vmax.z : vmin.z, 1.0f);
+    int sides = 0;
+    if (c.x < -c.w) sides |= 0x01;
+    if (c.x >  c.w) sides |= 0x02;
+    if (c.y < -c.w) sides |= 0x04;
+    if (c.y >  c.w) sides |= 0x08;
+    if (c.z < -c.w) sides |= 0x10;
+    if (c.z >  c.w) sides |= 0x20;
+    outside &= sides;
+  }
+  return outside != 0;
+}
+
 bool AABox::isValid(void) const
 {
   return (isEmpty() || ((vmax.x >= vmin.x) && (vmax.y >= vmin.y) && (vmax.z >= vmin.z))) ? true: false;
@@ -27,7 +27,11 @@ public:
   void operator += (const Sphere& sphere);
   void operator += (const Vertex& vertex);
   bool operator < (const AABox& aabox) const;
+  bool operator == (const AABox& aabox) const;
+  bool operator != (const AABox& aabox) const { return !(*this == aabox); }
   AABox transform(Matrix4x4& M);
+  /* are all corners on the outside of one side of the clip volume of M? */
+  bool isOutside(const Matrix4x4& M) const;
   Vertex getCenter(void) const;
   Vertex vmin, vmax;
 };
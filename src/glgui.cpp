@@ -3,6 +3,7 @@
 //
 
 #include <cstdio>
+#include <algorithm>
 #ifdef HAVE_FREETYPE
 #include "FTGL/ftgl.h"
 #include "R.h"
@@ -14,6 +15,7 @@
 #include "RenderContext.h"
 #include "subscene.h"
 #include "platform.h"
+#include "GlyphAtlas.h"
 
 using namespace rgl;
 
@@ -22,30 +24,22 @@ using namespace rgl;
 //   GLFont
 //
 
-GLboolean GLFont::justify(double twidth, double theight, 
-                          double adjx, double adjy, double adjz,
-                          int pos, const RenderContext& rc) {
-#ifndef RGL_NO_OPENGL
-  GLdouble pos1[4], pos2[4];
-  double basex = 0.0, basey = 0.0, basez = 0.5, scaling = 1.0;
-  GLboolean valid;
-  gl2ps_centering = GL2PS_TEXT_BL;
-  
+void GLFont::adjustForPos(double twidth, int pos, double* adjx, double* adjy, double* adjz) {
   if (pos) {
-    double offset = adjx, w = width("m");
+    double offset = *adjx, w = width("m");
     switch(pos) {
 	case 0:
     case 1:
     case 3:
     case 5:
     case 6:
-      adjx = 0.5;
+      *adjx = 0.5;
       break;
     case 2:
-      adjx = 1.0 + w*offset/twidth;
+      *adjx = 1.0 + w*offset/twidth;
       break;
     case 4:
-      adjx = -w*offset/twidth;
+      *adjx = -w*offset/twidth;
       break;
     }
     switch(pos) {
@@ -54,13 +48,13 @@ GLboolean GLFont::justify(double twidth, double theight,
     case 4:
     case 5:
     case 6:
-      adjy = 0.5;
+      *adjy = 0.5;
       break;
     case 1:
-      adjy = 1.0 + offset;
+      *adjy = 1.0 + offset;
       break;
     case 3:
-      adjy = -offset;
+      *adjy = -offset;
       break;
     }
     switch(pos) {
@@ -69,16 +63,28 @@ GLboolean GLFont::justify(double twidth, double theight,
     case 2:
     case 3:
     case 4:
-	  adjz = 0.5;
+	  *adjz = 0.5;
 	  break;
     case 5:
-      adjz = 1.0 + offset;
+      *adjz = 1.0 + offset;
       break;
     case 6:
-      adjz = -offset;
+      *adjz = -offset;
       break;
     }
   }
+}
+
+GLboolean GLFont::justify(double twidth, double theight, 
+                          double adjx, double adjy, double adjz,
+                          int pos, const RenderContext& rc) {
+#ifndef RGL_NO_OPENGL
+  GLdouble pos1[4], pos2[4];
+  double basex = 0.0, basey = 0.0, basez = 0.5, scaling = 1.0;
+  GLboolean valid;
+  gl2ps_centering = GL2PS_TEXT_BL;
+  
+  adjustForPos(twidth, pos, &adjx, &adjy, &adjz);
   
   if (adjx > 0) {
 
@@ -194,7 +200,7 @@ void GLBitmapFont::draw(const wchar_t* text, int length,
 #ifdef HAVE_FREETYPE
 
 GLFTFont::GLFTFont(const char* in_family, int in_style, double in_cex, const char* in_fontname) 
-: GLFont(in_family, in_style, in_cex, in_fontname, true)
+: GLFont(in_family, in_style, in_cex, in_fontname, true), atlas(NULL), atlasFailed(false)
 {
   font=new FTGLPixmapFont(fontname);
   if (font->Error()) { 
@@ -220,6 +226,45 @@ GLFTFont::GLFTFont(const char* in_family, int in_style, double in_cex, const cha
 GLFTFont::~GLFTFont()
 {
   if (font) delete font;
+  if (atlas) atlas->unref();
+}
+
+GlyphAtlas* GLFTFont::getAtlas()
+{
+  if (!atlas && !atlasFailed && font) {
+    atlas = new GlyphAtlas(fontname);
+    atlas->ref();
+    if (!atlas->isValid()) {
+      atlas->unref();
+      atlas = NULL;
+      atlasFailed = true;
+    }
+  }
+  return atlas;
+}
+
+double GLFTFont::getAtlasScale()
+{
+  return std::max(16*cex, 1.0)/GlyphAtlas::getSize();
+}
+
+/* The fonts of a window only differ in cex within a family and style,
+   and the atlas is independent of cex, so the first font of a face
+   opens the atlas and the others take a reference to it. */
+
+void GLFTFont::shareAtlas(const std::vector<GLFont*>& fonts)
+{
+  for (size_t i = 0; i < fonts.size(); i++) {
+    GLFont* other = fonts[i];
+    if (other && other != this && other->useFreeType && !strcmp(other->fontname, fontname)) {
+      GlyphAtlas* shared = static_cast<GLFTFont*>(other)->getAtlas();
+      if (shared && !atlas) {
+        atlas = shared;
+        atlas->ref();
+      }
+      return;
+    }
+  }
 }
 
 double GLFTFont::width(const char* text) {
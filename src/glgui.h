@@ -14,6 +14,8 @@
 
 namespace rgl {
 
+class GlyphAtlas;
+
 // CLASS
 //   GLFont
 //
@@ -47,6 +49,12 @@ public:
   virtual double width(const wchar_t* text) = 0;
   virtual double height() = 0;
   virtual bool valid(const char* text) { return true; };
+  // the glyphs as a texture, if the font can supply them
+  virtual GlyphAtlas* getAtlas() { return NULL; };
+  // window pixels per pixel of the atlas metrics
+  virtual double getAtlasScale() { return 1.0; };
+  // replace the adjustments by those implied by pos, if it is set
+  void adjustForPos(double width, int pos, double* adjx, double* adjy, double* adjz);
   // justify returns false if justification puts the text outside the viewport
   GLboolean justify(double width, double height, 
                     double adjx, double adjy, double adjz,
@@ -127,9 +135,16 @@ public:
   double width(const char* text);
   double width(const wchar_t* text);
   double height();
+  GlyphAtlas* getAtlas();
+  double getAtlasScale();
+  // use the atlas of another FreeType font in fonts with the same fontname
+  void shareAtlas(const std::vector<GLFont*>& fonts);
   
   FTFont *font;
   const char *errmsg;
+private:
+  GlyphAtlas* atlas;
+  bool atlasFailed;
 #endif
 };
 
@@ -113,6 +113,10 @@ void View::resize(int inWidth, int inHeight)
   height = inHeight;
 }
 // ---------------------------------------------------------------------------
+void View::releaseGL(void)
+{
+}
+// ---------------------------------------------------------------------------
 void View::relocate(int inBaseX, int inBaseY)
 {
   baseX = inBaseX;
@@ -155,6 +159,8 @@ Window::Window(View* in_child, GUIFactory* factory)
 , title("untitled")
 {
   skipRedraw = false;  
+  dirty = false;
+  dirtySince = 0.0;
   
   if (!factory){
     return;
@@ -189,11 +195,34 @@ void Window::setTitle(const char* in_title)
     windowImpl->setTitle(in_title);
 }
 // ---------------------------------------------------------------------------
+// Changes to the scene only mark the window as dirty; the platform
+// paints once the event loop is idle, so adding many objects in a row
+// costs one frame.  If changes keep coming for longer than
+// FRAME_DEADLINE seconds, a frame is drawn anyway, unless the window
+// isn't displayed at all.
+
+#define FRAME_DEADLINE 0.2
+
 void Window::update(void)
 {
+  double now = getTime();
+  if (!dirty) {
+    dirty = true;
+    dirtySince = now;
+    if (skipRedraw || windowImpl->invalidate())
+      return;
+  } else if (skipRedraw || now - dirtySince < FRAME_DEADLINE
+             || !windowImpl->isDisplayed())
+    return;
   windowImpl->update();
 }
 // ---------------------------------------------------------------------------
+void Window::flush(void)
+{
+  if (dirty && !skipRedraw)
+    windowImpl->update();
+}
+// ---------------------------------------------------------------------------
 void Window::setVisibility(bool state)
 {
   if (state)
@@ -235,7 +264,7 @@ int Window::getSkipRedraw(void)
 void Window::setSkipRedraw(int in_skipRedraw, int doUpdate)
 {
   skipRedraw = (bool)in_skipRedraw;
-  if (!skipRedraw && doUpdate) update();
+  if (!skipRedraw && doUpdate) windowImpl->update();
 }
 // ---------------------------------------------------------------------------
 void Window::show(void)
@@ -258,6 +287,7 @@ void Window::resize(int in_width, int in_height)
 // ---------------------------------------------------------------------------
 void Window::paint(void)
 {
+  dirty = false;
   if (child)
     child->paint();
 }
@@ -301,6 +331,12 @@ void Window::wheelRotate(int dir, int mouseX, int mouseY)
     child->wheelRotate(dir, mouseX, mouseY);
 }
 // ---------------------------------------------------------------------------
+void Window::releaseGL(void)
+{
+  if (child)
+    child->releaseGL();
+}
+// ---------------------------------------------------------------------------
 void Window::on_close()
 {
   if (windowImpl)
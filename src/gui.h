@@ -71,6 +71,10 @@ public:
   virtual void show(void) = 0;
   virtual void hide(void) = 0;
   virtual void update(void) = 0;
+  /// @doc ask for a paint once the event loop is idle; false if that is not possible
+  virtual bool invalidate(void) { return false; }
+  /// @doc false if nothing is shown, so frames are only needed on flush
+  virtual bool isDisplayed(void) { return true; }
 
   virtual void bringToTop(int stay) = 0;
 
@@ -148,6 +152,10 @@ public:
   virtual void mouseMove(int mouseX, int mouseY);
   virtual void captureLost();
 
+// called with the context current, before it is destroyed:
+
+  virtual void releaseGL(void);
+
 // protected services:
 
   virtual void setWindowImpl(WindowImpl* impl);
@@ -177,6 +185,7 @@ public:
   void setTitle(const char* title);
   void setVisibility(bool state);
   void update(void);
+  void flush(void);
   int getSkipRedraw(void);
   void setSkipRedraw(int in_skipRedraw, int doUpdate = 1);
 
@@ -193,6 +202,7 @@ public:
   void hide();
   void resize(int width, int height);
   void paint();
+  void releaseGL();
   void on_close();
   void notifyDestroy();
   void buttonPress(int button, int mouseX, int mouseY);
@@ -211,6 +221,8 @@ public:
   View* child;
   const char* title;
   bool skipRedraw;  
+  bool dirty;		/* a paint is pending */
+  double dirtySince;
 };
 // ---------------------------------------------------------------------------
 
@@ -408,6 +408,8 @@ namespace rgl {
 const char* mouseModes[] = {"none", "trackball", "xAxis", "yAxis", "zAxis", "polar", "selecting", "zoom", "fov", "user",
                             "push", "pull", "user2"};
 const char* viewportlabels[] = {"x", "y", "width", "height"};
+/* These must match TransparencyModeID in subscene.h */
+const char* transparencyModes[] = {"sort", "oit"};
 }
 
 #define mmLAST 10
@@ -544,6 +546,19 @@ static void Specify(Device* dev, RGLView* rglview, Subscene* sub, const char *wh
     if (!setUseFreeType(LOGICAL(x)[0], rglview)) success = 0;
     UNPROTECT(1);
   }
+  else if (streql(what, "transparency")) {
+    lengthCheck(what, value, 1);
+    PROTECT(x=Rf_coerceVector(value, STRSXP));
+    success = 0;
+    if (STRING_ELT(x, 0) != NA_STRING)
+      for (int mode = 0; mode < tmLAST; mode++)
+        if (Rf_psmatch(OLDCAST transparencyModes[mode], CHAR(STRING_ELT(x, 0)), (Rboolean)FALSE)) {
+          sub->setTransparency((TransparencyModeID)mode);
+          success = 1;
+          break;
+        }
+    UNPROTECT(1);
+  }
   
   else Rf_warning(_("parameter \"%s\" cannot be set"), what);
   
@@ -565,6 +580,13 @@ static SEXP Query(Device* dev, RGLView* rglview, Subscene* sub, const char *what
   
   value = R_NilValue;
   
+  /* these are computed when the scene is drawn, so a pending
+     frame must be drawn first */
+  if (streql(what, "modelMatrix") || streql(what, "projMatrix") 
+   || streql(what, "viewport") || streql(what, "observer") 
+   || streql(what, "bbox"))
+    dev->flush();
+  
   if (streql(what, "FOV")) {
     PROTECT(value = Rf_allocVector(REALSXP, 1));
     getFOV(REAL(value), sub);
@@ -676,6 +698,9 @@ static SEXP Query(Device* dev, RGLView* rglview, Subscene* sub, const char *what
       LOGICAL(value)[0] = (bool)useFreeType;
     }
   }    
+  else if (streql(what, "transparency")) {
+    PROTECT(value = Rf_mkString(transparencyModes[sub->getTransparency()]));
+  }
   else if (streql(what, "fontname")) {
     buf = getFontname(rglview);
     if (buf) {
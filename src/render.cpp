@@ -39,6 +39,7 @@ void VertexArray::alloc(int in_nvertex)
   nvertex = in_nvertex;
   if (nvertex)
     arrayptr = new float [nvertex*3];
+  buffer.invalidate();
 }
 
 void VertexArray::copy(int in_nvertex, double* vertices)
@@ -53,6 +54,7 @@ void VertexArray::copy(int in_nvertex, double* vertices)
     arrayptr[i*3+1] = (float) vertices[i*3+1];
     arrayptr[i*3+2] = (float) vertices[i*3+2];
   }
+  buffer.invalidate();
 }
 
 void VertexArray::copy(int in_nvertex, float* vertices)
@@ -67,9 +69,10 @@ void VertexArray::copy(int in_nvertex, float* vertices)
     arrayptr[i*3+1] = (float) vertices[i*3+1];
     arrayptr[i*3+2] = (float) vertices[i*3+2];
   }
+  buffer.invalidate();
 }
 
-void VertexArray::duplicate(VertexArray source)
+void VertexArray::duplicate(VertexArray& source)
 {
   alloc(source.size());
   copy(nvertex, source.arrayptr);
@@ -79,18 +82,24 @@ void VertexArray::setVertex(int index, double* v) {
   arrayptr[index*3+0] = (float) v[0];
   arrayptr[index*3+1] = (float) v[1];
   arrayptr[index*3+2] = (float) v[2];
+  buffer.invalidate(index*3*sizeof(float), 3*sizeof(float));
 }
 
 void VertexArray::setVertex(int index, Vertex v) {
   arrayptr[index*3+0] = (float) v.x;
   arrayptr[index*3+1] = (float) v.y;
   arrayptr[index*3+2] = (float) v.z;
+  buffer.invalidate(index*3*sizeof(float), 3*sizeof(float));
 }
 
 void VertexArray::beginUse() {
 #ifndef RGL_NO_OPENGL
   glEnableClientState(GL_VERTEX_ARRAY);
-  glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*) arrayptr );
+  if (buffer.bind(arrayptr, nvertex*3*sizeof(float))) {
+    glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*) 0 );
+    buffer.unbind();
+  } else
+    glVertexPointer(3, GL_FLOAT, 0, (const GLvoid*) arrayptr );
 #endif
 }
 
@@ -126,7 +135,11 @@ Vertex VertexArray::getNormal(int iv1, int iv2, int iv3)
 void NormalArray::beginUse() {
 #ifndef RGL_NO_OPENGL
   glEnableClientState(GL_NORMAL_ARRAY);
-  glNormalPointer(GL_FLOAT, 0, (const GLvoid*) arrayptr );
+  if (buffer.bind(arrayptr, nvertex*3*sizeof(float))) {
+    glNormalPointer(GL_FLOAT, 0, (const GLvoid*) 0 );
+    buffer.unbind();
+  } else
+    glNormalPointer(GL_FLOAT, 0, (const GLvoid*) arrayptr );
 #endif
 }
 
@@ -163,6 +176,7 @@ void TexCoordArray::alloc(int in_nvertex)
   nvertex = in_nvertex;
   if (nvertex)
     arrayptr = new float[2*nvertex];
+  buffer.invalidate();
 }
 
 TexCoord& TexCoordArray::operator [] (int index) {
@@ -173,7 +187,11 @@ void TexCoordArray::beginUse() {
 #ifndef RGL_NO_OPENGL
   if (arrayptr) {
     glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glTexCoordPointer(2, GL_FLOAT, 0, (const GLvoid*) arrayptr );
+    if (buffer.bind(arrayptr, nvertex*2*sizeof(float))) {
+      glTexCoordPointer(2, GL_FLOAT, 0, (const GLvoid*) 0 );
+      buffer.unbind();
+    } else
+      glTexCoordPointer(2, GL_FLOAT, 0, (const GLvoid*) arrayptr );
   }
 #endif
 }
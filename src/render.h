@@ -2,6 +2,7 @@
 #define RENDER_H
 
 #include "RenderContext.h"
+#include "BufferObject.h"
 
 #include "types.h"
 
@@ -25,7 +26,7 @@ public:
   void alloc(int in_nvertex);
   void copy(int in_nvertex, double* vertices);
   void copy(int in_nvertex, float* vertices);
-  void duplicate(VertexArray source);
+  void duplicate(VertexArray& source);
   void beginUse();
   void endUse();
   Vertex& operator[](int index);
@@ -35,9 +36,19 @@ public:
   Vertex getNormal(int v1, int v2, int v3);
   int size() { return nvertex; }
 
+  /**
+   * keep a copy in a buffer object when drawing
+   **/
+  void useBufferObject(bool in_use) { buffer.setEnabled(in_use); }
+  /**
+   * to be called after changing vertices through operator[]
+   **/
+  void invalidateBuffer() { buffer.invalidate(); }
+
 protected:
   int nvertex;
   float* arrayptr;
+  BufferObject buffer;
 };
 
 inline Vertex& VertexArray::operator[](int index) {
@@ -74,9 +85,13 @@ public:
   TexCoord& operator[](int index);
   int size() { return nvertex; };
 
+  void useBufferObject(bool in_use) { buffer.setEnabled(in_use); }
+  void invalidateBuffer() { buffer.invalidate(); }
+
 private:
   int nvertex;
   float* arrayptr;
+  BufferObject buffer;
 };
 
 } // namespace rgl
@@ -15,19 +15,29 @@
 #include "pixmap.h"
 #include "fps.h"
 #include "gl2ps.h"
+#include "SpriteSet.h"
+#include "SphereSet.h"
+#include "TextSet.h"
 
 #include "R.h"		// for Rf_error()
 
 using namespace rgl;
 
 RGLView::RGLView(Scene* in_scene)
- : View(0,0,256,256,0), autoUpdate(false)
+ : View(0,0,256,256,0), spriteProgram(SpriteSet::vertexShader, NULL),
+   sphereProgram(SphereSet::impostorVertexShader, SphereSet::impostorFragmentShader),
+   glyphProgram(TextSet::glyphVertexShader, TextSet::glyphFragmentShader),
+   autoUpdate(false)
 {
   scene = in_scene;
   flags = 0;
 
   renderContext.rect.x = 0;
   renderContext.rect.y = 0; // size is set elsewhere
+  renderContext.oit = &oit;
+  renderContext.spriteProgram = &spriteProgram;
+  renderContext.sphereProgram = &sphereProgram;
+  renderContext.glyphProgram = &glyphProgram;
   
   activeSubscene = 0;
 }
@@ -37,6 +47,17 @@ RGLView::~RGLView()
 
 }
 
+/* The window calls this before it destroys the context; the
+   destructor runs too late to free GL objects. */
+
+void RGLView::releaseGL()
+{
+  oit.releaseGL();
+  spriteProgram.release();
+  sphereProgram.release();
+  glyphProgram.release();
+}
+
 void RGLView::show()
 {
   fps.init( getTime() );
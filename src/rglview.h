@@ -9,6 +9,7 @@
 #include "gui.h"
 #include "fps.h"
 #include "pixmap.h"
+#include "OITBuffer.h"
 
 namespace rgl {
 
@@ -31,6 +32,7 @@ public:
   void wheelRotate(int dir, int mouseX, int mouseY);
   void captureLost();
   void keyPress(int code);
+  void releaseGL();
   Scene* getScene();
 
   void        getUserMatrix(double* dest);
@@ -86,6 +88,10 @@ private:
 // o CONTEXT
   
   RenderContext renderContext;
+  OITBuffer     oit;
+  ShaderProgram spriteProgram;
+  ShaderProgram sphereProgram;
+  ShaderProgram glyphProgram;
 
   bool autoUpdate;
 
@@ -9,6 +9,7 @@
 #include "render.h"
 #include "geom.h"
 #include <map>
+#include <unordered_set>
 #include <algorithm>
 #include <functional>
 #include "R.h"
@@ -27,8 +28,10 @@ Scene::Scene()
 : rootSubscene(EMBED_REPLACE, EMBED_REPLACE, EMBED_REPLACE, EMBED_REPLACE, false),
   doIgnoreExtent(false)
 {
+  for (int i = 0; i <= MAX_TYPE; i++)
+    typeCount[i] = 0;
   nodes.reserve(6);
-  nodes.push_back( currentSubscene = &rootSubscene );
+  addNode( currentSubscene = &rootSubscene );
  
   add( new UserViewpoint );
   add( new ModelViewpoint );
@@ -58,94 +61,164 @@ ModelViewpoint* Scene::getModelViewpoint()
 
 bool Scene::clear(TypeID type)
 {
+  std::vector<int> ids;
   std::vector<SceneNode*>::iterator iter;
-  for (iter = nodes.begin(); iter != nodes.end();) {
+  for (iter = nodes.begin(); iter != nodes.end(); ++iter) {
     if ((*iter)->getTypeID() == type) {
       SceneNode* node = (*iter);
       int id = node->getObjID();
       if (id == rootSubscene.getObjID()) 
-        ++iter;
-      else {
-        hide(node->getObjID());
-      	if (node->owner) {
-      	  ++iter;
-      	} else {
-          delete node;
-          iter = nodes.erase(iter);
-      	} 
-      }
-    } else
-      ++iter;
+        continue;
+      if (node->owner)
+        hide(id);
+      else
+        ids.push_back(id);
+    }
   }
+  if (ids.size())
+    pop(type, &ids[0], ids.size());
   SAVEGLERROR;
   return true;
 }
 
 bool Scene::add(SceneNode* node)
 {
-  nodes.push_back( node );
+  addNode( node );
   return currentSubscene->add(node);
 }  
 
+void Scene::addNode(SceneNode* node)
+{
+  nodes.push_back( node );
+  nodeIndex[node->getObjID()] = node;
+  TypeID type = node->getTypeID();
+  if (type <= MAX_TYPE)
+    typeCount[type]++;
+  if (type == SUBSCENE)
+    subscenes.push_back(static_cast<Subscene*>(node));
+  else if (type == SHAPE && node->getTypeName() == "sprites")
+    spriteSets.push_back(static_cast<SpriteSet*>(node));
+}
+
+/* Drops the node from the lookups; the caller erases it from nodes. */
+
+void Scene::removeNode(SceneNode* node)
+{
+  nodeIndex.erase(node->getObjID());
+  TypeID type = node->getTypeID();
+  if (type <= MAX_TYPE)
+    typeCount[type]--;
+  if (type == SUBSCENE) {
+    std::vector<Subscene*>::iterator found = std::find(subscenes.begin(), subscenes.end(), node);
+    if (found != subscenes.end())
+      subscenes.erase(found);
+  } else if (type == SHAPE) {
+    std::vector<SpriteSet*>::iterator found = std::find(spriteSets.begin(), spriteSets.end(), node);
+    if (found != spriteSets.end())
+      spriteSets.erase(found);
+  }
+}
+
 bool Scene::pop(TypeID type, int id)
 {
-  std::vector<SceneNode*>::iterator iter;
+  return pop(type, &id, 1) == 1;
+}
+
+static bool isChosen(SceneNode* node, const std::unordered_set<SceneNode*>* chosen)
+{
+  return chosen->count(node) > 0;
+}
+
+/* Shapes and lights, the bulk of any large scene, are dropped from every
+   subscene and sprite set with one pass over each list; the few nodes
+   of other types are hidden one at a time. */
+
+int Scene::pop(TypeID type, const int* ids, int n)
+{
+  std::vector<SceneNode*> removed;
+  std::unordered_set<SceneNode*> chosen;
+  int i;
   
-  if (id == 0) {  
-    for (iter = nodes.end(); iter != nodes.begin();) {
-      --iter;
-      if ((*iter)->getTypeID() == type) {
-        id = (*iter)->getObjID();
-        break;
-      }
+  for (i = 0; i < n; i++) {
+    SceneNode* node = NULL;
+    if (ids[i] == 0) {
+      std::vector<SceneNode*>::reverse_iterator riter;
+      for (riter = nodes.rbegin(); riter != nodes.rend(); ++riter)
+        if ((*riter)->getTypeID() == type && !chosen.count(*riter)) {
+          node = *riter;
+          break;
+        }
+    } else {
+      node = get_scenenode(ids[i]);
+      if (node && chosen.count(node))  /* already gone */
+        node = NULL;
     }
-    if (!id) return false;
-  }
-  iter = std::find_if(nodes.begin(), nodes.end(), 
-//		      std::bind(std::ptr_fun(&sameID), placeholders::_1, id));
-          std::bind(&sameID, std::placeholders::_1, id));
-  if (iter != nodes.end()) {
-    SceneNode* node = *iter;  
+    if (!node) 
+      break;
     if (node == &rootSubscene) 
-      return true;
-    hide((*iter)->getObjID());
-    // Rprintf("removing references to %d\n", id);
-    removeReferences(*iter); /* Might be in mouseListeners */
-    nodes.erase(iter);
-    delete node;
-
-    return true;
+      continue;
+    chosen.insert(node);
+    removed.push_back(node);
+  }
+  if (removed.empty())
+    return i;
+  
+  ObjIDSet shapeIDs;
+  std::vector<SceneNode*>::iterator iter;
+  for (iter = removed.begin(); iter != removed.end(); ++iter) {
+    SceneNode* node = *iter;
+    TypeID nodetype = node->getTypeID();
+    if (nodetype == SHAPE || nodetype == LIGHT)
+      shapeIDs.insert(node->getObjID());
+    else {
+      hide(node->getObjID());
+      removeReferences(node); /* Might be in mouseListeners */
+    }
+  }
+  if (!shapeIDs.empty()) {
+    for (std::vector<Subscene*>::iterator isub = subscenes.begin(); isub != subscenes.end(); ++isub) {
+      (*isub)->hideShapes(shapeIDs);
+      (*isub)->hideLights(shapeIDs);
+    }
+    for (std::vector<SpriteSet*>::iterator isprite = spriteSets.begin(); isprite != spriteSets.end(); ++isprite)
+      (*isprite)->remove_shapes(shapeIDs);
   }
   
-  return false;
+  for (iter = removed.begin(); iter != removed.end(); ++iter)
+    removeNode(*iter);
+  nodes.erase(std::remove_if(nodes.begin(), nodes.end(),
+                             std::bind(&isChosen, std::placeholders::_1, &chosen)),
+              nodes.end());
+  for (iter = removed.begin(); iter != removed.end(); ++iter)
+    delete *iter;
+  
+  return i;
 }
 
 void Scene::hide(int id)
 {
-  std::vector<SceneNode*>::iterator inode;
+  std::vector<Subscene*>::iterator isub;
   SceneNode* node = get_scenenode(id);
   if (node) {
     TypeID type = node->getTypeID();
-    for (inode = nodes.begin(); inode != nodes.end(); ++inode) {
-      if ((*inode)->getTypeID() == SUBSCENE) {
-        Subscene* subscene = static_cast<Subscene*>((*inode));
-        switch (type) {
-          case SUBSCENE: currentSubscene = subscene->hideSubscene(id, currentSubscene);
-            break;
-          case SHAPE: subscene->hideShape(id);
-            break;
-          case LIGHT: subscene->hideLight(id);
-            break;
-          case BBOXDECO: subscene->hideBBoxDeco(id);
-            break;
-          case BACKGROUND: subscene->hideBackground(id);
-            break;
-          case USERVIEWPOINT:
-          case MODELVIEWPOINT:
-            subscene->hideViewpoint(id);
-            break;
-          default: Rf_error("hiding type %d not implemented", type);
-        }
+    for (isub = subscenes.begin(); isub != subscenes.end(); ++isub) {
+      Subscene* subscene = *isub;
+      switch (type) {
+        case SUBSCENE: currentSubscene = subscene->hideSubscene(id, currentSubscene);
+          break;
+        case SHAPE: subscene->hideShape(id);
+          break;
+        case LIGHT: subscene->hideLight(id);
+          break;
+        case BBOXDECO: subscene->hideBBoxDeco(id);
+          break;
+        case BACKGROUND: subscene->hideBackground(id);
+          break;
+        case USERVIEWPOINT:
+        case MODELVIEWPOINT:
+          subscene->hideViewpoint(id);
+          break;
+        default: Rf_error("hiding type %d not implemented", type);
       }
     }
   }
@@ -154,49 +227,38 @@ void Scene::hide(int id)
 void Scene::removeReferences(SceneNode* node) {
   int id = node->getObjID(), type = node->getTypeID();
   // Rprintf("node id = %d type = %u\n", id, node);
-  for (std::vector<SceneNode*>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter) {
-    int itertype = (*iter)->getTypeID();
-    // Rprintf("itertype = %u\n", itertype);
-    if (itertype == SUBSCENE) {
-      Subscene* subscene = (Subscene*)*iter;
-      switch (type) {
-      case SUBSCENE:
-        subscene->deleteMouseListener((Subscene*)node);
-        setCurrentSubscene(subscene->hideSubscene(id, getCurrentSubscene() ) );
-        break;
-      case SHAPE:
-        subscene->hideShape(id);
-        break;
-      case LIGHT:
-        subscene->hideLight(id);
-        break;
-      case BACKGROUND:
-        subscene->hideBackground(id);
-        break;
-      case USERVIEWPOINT:
-      case MODELVIEWPOINT:
-        subscene->hideViewpoint(id);
-        break;
-      }
-    } else if (itertype == SHAPE) {
-      if ((*iter)->getTypeName() == "sprites") {
-        // Rprintf("removing from sprites\n");
-        SpriteSet* sprite = (SpriteSet*)*iter;
-        sprite->remove_shape(id);
-      }
+  for (std::vector<Subscene*>::iterator iter = subscenes.begin(); iter != subscenes.end(); ++iter) {
+    Subscene* subscene = *iter;
+    switch (type) {
+    case SUBSCENE:
+      subscene->deleteMouseListener((Subscene*)node);
+      setCurrentSubscene(subscene->hideSubscene(id, getCurrentSubscene() ) );
+      break;
+    case SHAPE:
+      subscene->hideShape(id);
+      break;
+    case LIGHT:
+      subscene->hideLight(id);
+      break;
+    case BACKGROUND:
+      subscene->hideBackground(id);
+      break;
+    case USERVIEWPOINT:
+    case MODELVIEWPOINT:
+      subscene->hideViewpoint(id);
+      break;
     }
   }
+  if (type == SHAPE)
+    for (std::vector<SpriteSet*>::iterator iter = spriteSets.begin(); iter != spriteSets.end(); ++iter) {
+      // Rprintf("removing from sprites\n");
+      (*iter)->remove_shape(id);
+    }
 }
 
 int Scene::get_id_count(TypeID type)
 {
-  int count = 0;
-  for (std::vector<SceneNode*>::iterator iter = nodes.begin();
-       iter != nodes.end(); ++iter) 
-    if (type == (*iter)->getTypeID())
-      count++;
-   
-  return count;
+  return type <= MAX_TYPE ? typeCount[type] : 0;
 }
 
 void Scene::get_ids(TypeID type, int* ids, char** types)
@@ -212,10 +274,8 @@ void Scene::get_ids(TypeID type, int* ids, char** types)
 
 SceneNode* Scene::get_scenenode(int id) 
 {
-  for (std::vector<SceneNode*>::iterator iter = nodes.begin(); iter != nodes.end(); ++iter) 
-    if (id == (*iter)->getObjID())
-      return *iter;
-  return NULL;
+  std::unordered_map<ObjID, SceneNode*>::const_iterator found = nodeIndex.find(id);
+  return found != nodeIndex.end() ? found->second : NULL;
 }
 
 SceneNode* Scene::get_scenenode(TypeID type, int id)
@@ -345,3 +405,8 @@ bool rgl::sameID(SceneNode* node, int id)
 { 
   return node->getObjID() == id; 
 }
+
+bool rgl::inIDSet(SceneNode* node, const ObjIDSet* ids)
+{
+  return ids->count(node->getObjID()) > 0;
+}
@@ -5,11 +5,14 @@
 // This file is part of RGL
 
 #include <vector>
+#include <unordered_map>
 #include "types.h"
 #include "subscene.h"
 
 namespace rgl {
 
+class SpriteSet;
+
 class Scene {
 public:
   Scene();
@@ -32,6 +35,13 @@ public:
    **/
   bool pop(TypeID stackTypeID, int id);
   
+  /**
+   * remove the n nodes in ids together, id 0 standing for the last-added
+   * node of the given type.  Stops at the first id not found, and
+   * returns the number of ids handled.
+   **/
+  int pop(TypeID stackTypeID, const int* ids, int n);
+  
   /**
    * hide specified node in all subscenes
    **/
@@ -144,6 +154,19 @@ private:
    * list of scene nodes.  The scene owns them, the subscenes display a subset.
    **/
   std::vector<SceneNode*> nodes;
+  
+  /**
+   * lookups kept in step with nodes by addNode() and removeNode(), so
+   * finding a node by id, counting a type or visiting the subscenes
+   * doesn't need a scan of all nodes
+   **/
+  std::unordered_map<ObjID, SceneNode*> nodeIndex;
+  int typeCount[MAX_TYPE + 1];
+  std::vector<Subscene*> subscenes;
+  std::vector<SpriteSet*> spriteSets;	/* they may hold other shapes */
+
+  void addNode(SceneNode* node);
+  void removeNode(SceneNode* node);
 
   void deleteAll(std::vector<SceneNode*> list);
   void removeReferences(SceneNode* node);
@@ -2,6 +2,7 @@
 #include "rglview.h"
 #include "select.h"
 #include "gl2ps.h"
+#include "OITBuffer.h"
 #include "R.h"
 #include <algorithm>
 #include <functional>
@@ -55,7 +56,7 @@ Subscene::Subscene(Embedding in_viewport, Embedding in_projection, Embedding in_
    do_model(in_model), do_mouseHandlers(in_mouseHandlers), 
    viewport(0.,0.,1.,1.),Zrow(), Wrow(),
    pviewport(0,0,1024,1024), drag(0), ignoreExtent(in_ignoreExtent),
-   selectState(msNONE), 
+   selectState(msNONE), transparency(tmSORT),
    dragBase(0.0f,0.0f), dragCurrent(0.0f,0.0f)
 {
   userviewpoint = NULL;
@@ -63,6 +64,7 @@ Subscene::Subscene(Embedding in_viewport, Embedding in_projection, Embedding in_
   bboxdeco   = NULL;
   background = NULL;
   bboxChanges = false;
+  renderQueueValid = false;
   data_bbox.invalidate();
   modelMatrix.setIdentity();
   projMatrix.setIdentity(); 
@@ -87,6 +89,7 @@ Subscene::~Subscene()
   for (int i=0; i<5; i++) 
     if (cleanupCallback[i]) 
       (*cleanupCallback[i])(userData + 3*i);
+  clearBatches();
 }
 
 bool Subscene::add(SceneNode* node)
@@ -171,11 +174,14 @@ void Subscene::addShape(Shape* shape)
   
   if ( shape->isBlended() ) {
     zsortShapes.push_back(shape);
+    zsortBuffer.invalidate();
   } else if ( shape->isClipPlane() ) {
     clipPlanes.push_back(static_cast<ClipPlaneSet*>(shape));
     newBBox();
-  } else
+  } else {
     unsortedShapes.push_back(shape);
+    renderQueueValid = false;
+  }
 }
 
 void Subscene::addBBox(const AABox& bbox, bool changes)
@@ -217,15 +223,45 @@ void Subscene::hideShape(int id)
         
   Shape* shape = *ishape;
   shapes.erase(ishape);
-  if ( shape->isBlended() )
+  if ( shape->isBlended() ) {
     zsortShapes.erase(std::find_if(zsortShapes.begin(), zsortShapes.end(),
                                    std::bind(&sameID, std::placeholders::_1, id)));
-  else if ( shape->isClipPlane() )
+    zsortBuffer.invalidate();
+  } else if ( shape->isClipPlane() )
     clipPlanes.erase(std::find_if(clipPlanes.begin(), clipPlanes.end(),
                      std::bind(&sameID, std::placeholders::_1, id)));
-  else
+  else {
     unsortedShapes.erase(std::find_if(unsortedShapes.begin(), unsortedShapes.end(),
                          std::bind(&sameID, std::placeholders::_1, id)));
+    renderQueueValid = false;
+  }
+      
+  newBBox();
+}
+
+void Subscene::hideShapes(const ObjIDSet& ids)
+{
+  size_t n = shapes.size();
+  shapes.erase(std::remove_if(shapes.begin(), shapes.end(),
+                              std::bind(&inIDSet, std::placeholders::_1, &ids)),
+               shapes.end());
+  if (shapes.size() == n) return;
+  
+  n = zsortShapes.size();
+  zsortShapes.erase(std::remove_if(zsortShapes.begin(), zsortShapes.end(),
+                                   std::bind(&inIDSet, std::placeholders::_1, &ids)),
+                    zsortShapes.end());
+  if (zsortShapes.size() != n)
+    zsortBuffer.invalidate();
+  clipPlanes.erase(std::remove_if(clipPlanes.begin(), clipPlanes.end(),
+                                  std::bind(&inIDSet, std::placeholders::_1, &ids)),
+                   clipPlanes.end());
+  n = unsortedShapes.size();
+  unsortedShapes.erase(std::remove_if(unsortedShapes.begin(), unsortedShapes.end(),
+                                      std::bind(&inIDSet, std::placeholders::_1, &ids)),
+                       unsortedShapes.end());
+  if (unsortedShapes.size() != n)
+    renderQueueValid = false;
       
   newBBox();
 }
@@ -255,6 +291,13 @@ void Subscene::hideBackground(int id)
   }
 }
 
+void Subscene::hideLights(const ObjIDSet& ids)
+{
+  lights.erase(std::remove_if(lights.begin(), lights.end(),
+                              std::bind(&inIDSet, std::placeholders::_1, &ids)),
+               lights.end());
+}
+
 Subscene* Subscene::hideSubscene(int id, Subscene* current)
 {
   for (std::vector<Subscene*>::iterator i = subscenes.begin(); i != subscenes.end(); ++ i) {
@@ -701,6 +744,8 @@ void Subscene::render(RenderContext* renderContext, bool opaquePass)
   // CLIP PLANES
   renderClipplanes(renderContext);
   
+  cullMatrix = Matrix4x4(projMatrix)*Matrix4x4(modelMatrix);
+  
   if (opaquePass) {
     
     if (renderContext->gl2psActive > GL2PS_NONE)
@@ -741,7 +786,8 @@ void Subscene::render(RenderContext* renderContext, bool opaquePass)
     Zrow = P.getRow(2);
     Wrow = P.getRow(3);
 
-    renderZsort(renderContext);
+    if (transparency != tmOIT || !renderOIT(renderContext))
+      renderZsort(renderContext);
 #endif    
   }
   /* Reset flag(s) now that scene has been rendered */
@@ -976,48 +1022,227 @@ void Subscene::setupLights(RenderContext* rctx)
 #endif
 }
 
-void Subscene::renderUnsorted(RenderContext* renderContext)
+/* A shape is culled if all corners of its bounding box are outside
+   the same side of the view volume, or behind one clip plane. */
+
+bool Subscene::isCulled(Shape* shape)
 {
-  std::vector<Shape*>::iterator iter;
+  return shape->isCullable() && isCulled(shape->getBoundingBox(this));
+}
 
-  for (iter = unsortedShapes.begin() ; iter != unsortedShapes.end() ; ++iter ) {
-    Shape* shape = *iter;
-    shape->render(renderContext);
+bool Subscene::isCulled(const AABox& bbox)
+{
+  if (!bbox.isValid() || bbox.isEmpty())
+    return false;
+  if (bbox.isOutside(cullMatrix))
+    return true;
+  std::vector<ClipPlaneSet*>::iterator iter;
+  for (iter = clipPlanes.begin() ; iter != clipPlanes.end() ; ++iter )
+    if ((*iter)->clipsBBox(bbox))
+      return true;
+  return false;
+}
+
+namespace {
+  /* batchable sets are grouped by primitive type as well, since a
+     PrimitiveBatch only holds one type; others have type -1 */
+  typedef std::pair<int, const Material*> GroupKey;
+
+  struct GroupKeyLess {
+    bool operator () (const GroupKey& a, const GroupKey& b) const {
+      if (a.first != b.first)
+        return a.first < b.first;
+      return a.second->compareState(*b.second) < 0;
+    }
+  };
+  
+  struct RankLess {
+    const std::vector<int>& rank;
+    RankLess(const std::vector<int>& in_rank) : rank(in_rank) { }
+    bool operator () (int a, int b) const { return rank[a] < rank[b]; }
+  };
+}
+
+/* Group the opaque shapes by material state and, for batchable sets,
+   primitive type, keeping groups in the order they first appear and
+   shapes in their order within a group.
+   Shapes whose depth settings make drawing order matter are not
+   moved, and nothing moves past them. */
+
+void Subscene::sortRenderQueue()
+{
+  int n = unsortedShapes.size(), next = 0;
+  std::vector<int> rank(n), order(n);
+  std::map<GroupKey, int, GroupKeyLess> groups;
+  for (int i = 0; i < n; i++) {
+    Shape* shape = unsortedShapes[i];
+    const Material* material = shape->getMaterial();
+    order[i] = i;
+    if (material->depth_test != 1 || !material->depth_mask) {
+      groups.clear();
+      rank[i] = next++;
+    } else {
+      GroupKey key(shape->isBatchable() ? static_cast<PrimitiveSet*>(shape)->getBatchType() : -1,
+                   material);
+      std::map<GroupKey, int, GroupKeyLess>::iterator group = groups.find(key);
+      if (group == groups.end())
+        group = groups.insert(std::make_pair(key, next++)).first;
+      rank[i] = group->second;
+    }
+  }
+  std::stable_sort(order.begin(), order.end(), RankLess(rank));
+  renderQueue.resize(n);
+  for (int i = 0; i < n; i++)
+    renderQueue[i] = unsortedShapes[order[i]];
+  renderQueueValid = true;
+  batchRenderQueue();
+}
+
+/* Runs of small sets in the queue with the same primitive type and
+   material state are drawn as one PrimitiveBatch.  The sets stay in
+   the subscene, so nothing else needs to know about the batch. */
+
+void Subscene::batchRenderQueue()
+{
+  clearBatches();
+  size_t n = renderQueue.size(), i = 0;
+  queueBatches.assign(n, (PrimitiveBatch*)NULL);
+  while (i < n) {
+    if (!renderQueue[i]->isBatchable()) {
+      i++;
+      continue;
+    }
+    PrimitiveBatch* batch = new PrimitiveBatch();
+    size_t j = i;
+    while (j < n && renderQueue[j]->isBatchable()
+                 && batch->add(static_cast<PrimitiveSet*>(renderQueue[j])))
+      j++;
+    if (j - i > 1)
+      queueBatches[i] = batch;
+    else
+      delete batch;
+    i = j;
+  }
+}
+
+void Subscene::clearBatches()
+{
+  std::vector<PrimitiveBatch*>::iterator iter;
+  for (iter = queueBatches.begin(); iter != queueBatches.end(); ++iter)
+    delete *iter;
+  queueBatches.clear();
+}
+
+/* Consecutive shapes with the same material state share one
+   Material::beginUse/endUse if both set it when drawn.  Textures
+   and gl2ps output keep their own calls. */
+
+static bool canShareMaterial(Shape* shape, PrimitiveBatch* batch)
+{
+  return batch || (shape->isDrawnDirectly() && !shape->getMaterial()->texture.get());
+}
+
+void Subscene::renderUnsorted(RenderContext* renderContext)
+{
+  if (!renderQueueValid)
+    sortRenderQueue();
+  
+  /* gl2ps output keeps the shapes separate */
+  bool share = renderContext->gl2psActive == GL2PS_NONE;
+  
+  visibleShapes.clear();
+  visibleBatches.clear();
+  for (size_t i = 0; i < renderQueue.size(); ) {
+    PrimitiveBatch* batch = share ? queueBatches[i] : NULL;
+    if (batch ? !isCulled(batch->getBoundingBox()) : !isCulled(renderQueue[i])) {
+      visibleShapes.push_back(renderQueue[i]);
+      visibleBatches.push_back(batch);
+    }
+    i += batch ? batch->size() : 1;
+  }
+  
+  for (size_t i = 0; i < visibleShapes.size(); i++) {
+    Shape* shape = visibleShapes[i];
+    PrimitiveBatch* batch = visibleBatches[i];
+    bool last = i + 1 == visibleShapes.size();
+    renderContext->materialKeep = share && !last
+                               && canShareMaterial(shape, batch) 
+                               && canShareMaterial(visibleShapes[i + 1], visibleBatches[i + 1])
+                               && !shape->getMaterial()->compareState(*visibleShapes[i + 1]->getMaterial());
+    if (batch)
+      batch->render(renderContext);
+    else
+      shape->render(renderContext);
+    renderContext->materialApplied = renderContext->materialKeep;
     SAVEGLERROR;
   }
+  renderContext->materialApplied = renderContext->materialKeep = false;
 }
     
 void Subscene::renderZsort(RenderContext* renderContext)
 {  
   std::vector<Shape*>::iterator iter;
-  std::multimap<float, ShapeItem*> distanceMap;
 
-  for (iter = zsortShapes.begin() ; iter != zsortShapes.end() ; ++iter ) {
-    Shape* shape = *iter;
-    shape->renderBegin(renderContext);
-    for (int j = 0; j < shape->getPrimitiveCount(); j++) {
-      ShapeItem* item = new ShapeItem(shape, j);
-      float distance = getDistance( shape->getPrimitiveCenter(j) );
-      distanceMap.insert( std::pair<const float,ShapeItem*>(-distance, item) );
-    }
-  }
+  /* All the shapes are sorted, so that the cached order survives
+     shapes moving in and out of view; culled ones are skipped when
+     drawing. */
+  culledShapes.clear();
+  for (iter = zsortShapes.begin() ; iter != zsortShapes.end() ; ++iter )
+    if (isCulled(*iter))
+      culledShapes.insert(*iter);
+    else
+      (*iter)->renderBegin(renderContext);
 
-  {
-    Shape* prev = NULL;
-    std::multimap<float,ShapeItem*>::iterator iter;
-    for (iter = distanceMap.begin() ; iter != distanceMap.end() ; ++ iter ) {
-      ShapeItem* item = iter->second;
-      Shape* shape = item->shape;
-      if (shape != prev) {
-        if (prev) prev->drawEnd(renderContext);
+  zsortBuffer.sort(zsortShapes, Zrow, Wrow);
+  
+  Shape* prev = NULL;
+  bool skip = false;
+  for (size_t i = 0; i < zsortBuffer.size(); i++) {
+    const ShapeItem& item = zsortBuffer[i];
+    Shape* shape = item.shape;
+    if (shape != prev) {
+      if (prev && !skip) prev->drawEnd(renderContext);
+      prev = shape;
+      skip = culledShapes.count(shape) > 0;
+      if (!skip)
         shape->drawBegin(renderContext);
-        prev = shape;
-      }
-      shape->drawPrimitive(renderContext, item->itemnum);
-      delete item;
     }
-    if (prev) prev->drawEnd(renderContext);
+    if (!skip)
+      shape->drawPrimitive(renderContext, item.itemnum);
   }
+  if (prev && !skip) prev->drawEnd(renderContext);
+}
+
+/* Draw the blended shapes in any order, accumulating them with
+   weighted blended OIT.  Returns false without drawing if that
+   isn't possible, in which case they should be sorted. */
+
+bool Subscene::renderOIT(RenderContext* renderContext)
+{
+  OITBuffer* oit = renderContext->oit;
+  if (!oit || renderContext->gl2psActive > GL2PS_NONE || zsortShapes.empty())
+    return false;
+  
+  std::vector<Shape*>::iterator iter;
+  for (iter = zsortShapes.begin() ; iter != zsortShapes.end() ; ++iter )
+    if (!OITBuffer::canDraw((*iter)->getMaterial()))
+      return false;
+  
+  if (!oit->begin(renderContext, pviewport))
+    return false;
+  
+  /* Display lists can't be used, since they record the blend function */
+  for (iter = zsortShapes.begin() ; iter != zsortShapes.end() ; ++iter ) {
+    Shape* shape = *iter;
+    if (isCulled(shape))
+      continue;
+    shape->renderBegin(renderContext);
+    shape->draw(renderContext);
+  }
+  
+  oit->end(renderContext);
+  SAVEGLERROR;
+  return true;
 }
 
 const AABox& Subscene::getBoundingBox()
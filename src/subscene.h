@@ -7,7 +7,10 @@
 #include "Background.h"
 #include "BBoxDeco.h"
 #include "Light.h"
+#include "ZSortBuffer.h"
+#include "PrimitiveBatch.h"
 #include <map>
+#include <set>
 
 
 namespace rgl {
@@ -22,6 +25,8 @@ enum MouseModeID {mmNONE = 0, mmTRACKBALL, mmXAXIS, mmYAXIS, mmZAXIS, mmPOLAR,
 
 enum MouseSelectionID {msNONE=1, msCHANGING, msDONE, msABORT};
 
+enum TransparencyModeID {tmSORT = 0, tmOIT, tmLAST};
+
 typedef void (*userControlPtr)(void *userData, int mouseX, int mouseY);
 typedef void (*userControlEndPtr)(void *userData);
 typedef void (*userCleanupPtr)(void **userData);
@@ -56,6 +61,24 @@ private:
   std::vector<Shape*> unsortedShapes;
   std::vector<Shape*> zsortShapes;
   std::vector<ClipPlaneSet*> clipPlanes;  
+  
+  /* Reusable storage for sorting the primitives of zsortShapes */
+  ZSortBuffer zsortBuffer;
+  
+  /* The shapes that are in view, those of zsortShapes that are not,
+     and the matrix used to decide */
+  std::vector<Shape*> visibleShapes;
+  std::set<Shape*> culledShapes;
+  Matrix4x4 cullMatrix;
+  
+  /* unsortedShapes grouped by material state */
+  std::vector<Shape*> renderQueue;
+  bool renderQueueValid;
+  
+  /* For each entry of renderQueue, the batch that draws it and the
+     entries after it, or NULL.  The batches are owned here. */
+  std::vector<PrimitiveBatch*> queueBatches;
+  std::vector<PrimitiveBatch*> visibleBatches;
 
   /* Subscenes form a tree; this is the parent subscene.  The root has a NULL parent. */
   Subscene* parent;
@@ -106,6 +129,12 @@ public:
   void hideBackground(int id);
   Subscene* hideSubscene(int id, Subscene* current);
   void hideViewpoint(int id);
+  
+  /**
+   * hide every shape or light in ids, with one pass over each list
+   **/
+  void hideShapes(const ObjIDSet& ids);
+  void hideLights(const ObjIDSet& ids);
 
   /**
    * recursive search for subscene; could return self, or NULL if not found
@@ -176,6 +205,17 @@ public:
   
   void renderUnsorted(RenderContext* renderContext);
   void renderZsort(RenderContext* renderContext);
+  bool renderOIT(RenderContext* renderContext);
+  
+  /**
+   * is the shape out of view or clipped away?  cullMatrix must be set.
+   **/
+  bool isCulled(Shape* shape);
+  bool isCulled(const AABox& bbox);
+  
+  void sortRenderQueue();
+  void batchRenderQueue();
+  void clearBatches();
   
   /**
    * Get and set flag to ignore elements in bounding box
@@ -264,6 +304,13 @@ public:
   MouseSelectionID getSelectState();
   void setSelectState(MouseSelectionID state);
   
+  /**
+   * how blended shapes are drawn:  sorted by depth, or with
+   * order independent transparency where the hardware allows it
+   **/
+  TransparencyModeID getTransparency() const { return transparency; }
+  void setTransparency(TransparencyModeID mode) { transparency = mode; }
+  
 private:
     
   /**
@@ -301,6 +348,8 @@ private:
   
   MouseSelectionID selectState;
   
+  TransparencyModeID transparency;
+  
   void noneBegin(int mouseX, int mouseY) {};
   void noneUpdate(int mouseX, int mouseY)  {};
   void noneEnd() {};
@@ -93,6 +93,7 @@ public:
   int  isTopmost(HWND handle);
   void bringToTop(int stay);
   void update();
+  bool invalidate();
   void destroy();
   void captureMouse(View* pView);
   void releaseMouse();
@@ -264,6 +265,13 @@ void Win32WindowImpl::update()
   SAVEGLERROR;
 }
 
+// WM_PAINT is sent once the message queue is empty, and repeated
+// invalidations are merged into one message.
+bool Win32WindowImpl::invalidate()
+{
+  return windowHandle && InvalidateRect(windowHandle, NULL, false);
+}
+
 void Win32WindowImpl::destroy()
 {
   if (gHandle) SendMessage(gMDIClientHandle, WM_MDIDESTROY, (WPARAM) windowHandle, 0);
@@ -470,6 +478,7 @@ GLFont* Win32WindowImpl::getFont(const char* family, int style, double cex,
       GLFTFont* font=new GLFTFont(family, style, cex, fontname_absolute);
       if (font->font) {
         fonts.push_back(font);
+        font->shareAtlas(fonts);
         UNPROTECT(1);
         return font;
       } else {
@@ -604,6 +613,11 @@ LRESULT Win32WindowImpl::processMessage(HWND hwnd, UINT message, WPARAM wParam,
       }
       break;
     case WM_DESTROY:
+      /* GL objects have to be freed while the context is current */
+      if (window && beginGL()) {
+        window->releaseGL();
+        endGL();
+      }
       shutdownGL();
 #if defined (WIN64) || defined(_MSC_VER) 
 	  SetWindowLongPtr(hwnd, GWLP_USERDATA, (long)NULL);
@@ -12,6 +12,7 @@
 #include "opengl.h"
 #include <X11/keysym.h>
 #include <cstdio>
+#include <cstring>
 #include "x11gui.h"
 #include "lib.h"
 #include "R.h"
@@ -39,6 +40,7 @@ public:
   void hide();
   void bringToTop(int stay);
   void update();
+  bool invalidate();
   void destroy();
   bool beginGL();
   void endGL();
@@ -63,6 +65,7 @@ private:
   ::GLXContext   glxctx;
   friend class X11GUIFactory;
   XVisualInfo* xvisualinfo;
+  bool exposePending;	/* invalidate() sent an Expose that hasn't arrived */
 };
 
 } // namespace rgl
@@ -76,6 +79,7 @@ X11WindowImpl::X11WindowImpl(Window* w, X11GUIFactory* f, ::Window in_xwindow, X
 , factory(f)
 , xwindow(in_xwindow)
 , xvisualinfo(invisualinfo)
+, exposePending(false)
 {
   on_init();
 }
@@ -172,6 +176,23 @@ void X11WindowImpl::update()
   SAVEGLERROR;
 }
 // ---------------------------------------------------------------------------
+// Send ourselves an Expose event; R reads it when it next waits for input.
+bool X11WindowImpl::invalidate()
+{
+  if (!exposePending) {
+    XEvent ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.xexpose.type = Expose;
+    ev.xexpose.display = factory->xdisplay;
+    ev.xexpose.window = xwindow;
+    if (!XSendEvent(factory->xdisplay, xwindow, False, ExposureMask, &ev))
+      return false;
+    factory->flushX();
+    exposePending = true;
+  }
+  return true;
+}
+// ---------------------------------------------------------------------------
 void X11WindowImpl::destroy()
 {
   if (xwindow != 0) 
@@ -310,6 +331,11 @@ void X11WindowImpl::processEvent(XEvent& ev)
           window->mouseMove( winx, winy );
       break;
     case Expose:
+      if (ev.xexpose.send_event) {
+        exposePending = false;
+        /* already painted when the frame deadline passed */
+        if (window && !window->dirty) break;
+      }
       if (ev.xexpose.count == 0) {
         if (window) {
           if (window->skipRedraw) break;
@@ -418,6 +444,7 @@ GLFont* X11WindowImpl::getFont(const char* family, int style, double cex,
       GLFTFont* font=new GLFTFont(family, style, cex, fontname);
       if (font->font) {
         fonts.push_back(font);
+        font->shareAtlas(fonts);
         UNPROTECT(4);
         return font;
       } else {
@@ -471,13 +498,20 @@ void X11WindowImpl::on_init()
 
 void X11WindowImpl::on_shutdown()
 {
-  if (glxctx)
+  if (glxctx) {
+    /* GL objects have to be freed while the context is current */
+    bool inGL = beginGL();
+    if (inGL && window)
+      window->releaseGL();
     for (unsigned int i=0; i < fonts.size(); i++) {
       if (fonts[i]) {
         delete fonts[i];
         fonts[i] = NULL;
       }
     }
+    if (inGL)
+      endGL();
+  }
   shutdownGL();
 }
 // ---------------------------------------------------------------------------